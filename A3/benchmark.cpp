@@ -0,0 +1,568 @@
+// Standard C++ library imports
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Local imports
+#include "heightMap.h"
+#include "terrainChunks.h"
+#include "terrainFilter.h"
+#include "terrainGenerator.h"
+#include "terrainGrid.h"
+#include "terrainMesh.h"
+#include "terrainPicker.h"
+#include "threadPool.h"
+
+// Number of correctness checks that failed, reported in exit status
+static int failedChecks = 0;
+
+// Milliseconds elapsed since given start time
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+// Report memory use and generation time of every generator for each
+// grid size, memory includes scratch space used while generating, mesh
+// memory is held by chunk meshes of whole grid at full detail within
+// default budget
+static void benchmarkGeneration(std::vector<int> &sizes)
+{
+	printf("%-8s %-10s %12s %10s %14s %14s\n", "grid", "generator",
+		"memory (MB)", "mesh (MB)", "generate (ms)", "normals (ms)");
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		TerrainGrid grid(sizes[i]);
+		for (int j = 0; TerrainGenerator::names[j] != NULL; j++)
+		{
+			TerrainGenerator *generator =
+				TerrainGenerator::create(TerrainGenerator::names[j]);
+
+			// Time generation
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			generator->generate(grid, 1);
+			double generateTime = elapsed(start);
+
+			// Time full normal computation for smooth triangles
+			GridRegion all = { 0, 0, grid.size - 1, grid.size - 1 };
+			start = std::chrono::steady_clock::now();
+			grid.computeNormals(all, 1, 1);
+			double normalTime = elapsed(start);
+
+			// Build meshes of every chunk as viewer would with whole grid
+			// in view at full detail
+			float origin = 0 - (grid.size - 1) / 2;
+			TerrainChunks chunks(grid.size, 64, origin, 0.1);
+			TerrainMesh mesh(&chunks, origin, defaultMeshBudget);
+			mesh.update(grid);
+
+			printf("%-8d %-10s %12.1f %10.1f %14.1f %14.1f\n", grid.size,
+				generator->name(), (grid.bytes()
+					+ generator->scratchBytes(grid.size)) / 1048576.0,
+				mesh.bytes / 1048576.0, generateTime, normalTime);
+			delete generator;
+		}
+	}
+}
+
+// Report face normals per second for scalar and vectorized kernels
+static void benchmarkNormals(int size)
+{
+	TerrainGrid grid(size);
+	for (size_t i = 0; i < (size_t)size * size; i++)
+		grid.heights[i] = rand() % 1000 / 100.0;
+	GridRegion cells = { 0, 0, size - 2, size - 2 };
+
+	// Each cell produces normals for two triangles (squares share one)
+	double normals = 2.0 * (size - 1) * (size - 1);
+	printf("\nFace normals on %d x %d grid:\n", size, size);
+	for (int useSimd = 0; useSimd <= 1; useSimd++)
+	{
+		// Best of several passes to reduce noise
+		double best = 0;
+		for (int pass = 0; pass < 5; pass++)
+		{
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			grid.computeFaceNormals(cells, useSimd);
+			double time = elapsed(start);
+			if (pass == 0 || time < best)
+				best = time;
+		}
+		printf("%-8s %10.1f ms %12.1f M normals/s\n",
+			useSimd ? "simd" : "scalar", best, normals / best / 1000);
+	}
+
+	// Both kernels must agree on every component of both face normal
+	// maps, each row of vector results is compared against scalar code
+	NormalMap *maps[] = { &grid.triangleXNormals, &grid.triangleZNormals };
+	std::vector<float> simd;
+	for (int x = 0; x < size - 1; x++)
+	{
+		simd.clear();
+		for (int m = 0; m < 2; m++)
+			for (float *plane : { maps[m]->nx, maps[m]->ny, maps[m]->nz })
+				simd.insert(simd.end(), plane + grid.index(x, 0),
+					plane + grid.index(x, size - 1));
+		GridRegion row = { x, 0, x, size - 2 };
+		grid.computeFaceNormals(row, 0);
+
+		size_t k = 0;
+		int same = 1;
+		for (int m = 0; m < 2; m++)
+			for (float *plane : { maps[m]->nx, maps[m]->ny, maps[m]->nz })
+				for (int z = 0; z < size - 1; z++)
+					same &= plane[grid.index(x, z)] == simd[k++];
+		if (!same)
+		{
+			printf("Mismatch between scalar and simd normals.\n");
+			failedChecks++;
+			break;
+		}
+	}
+}
+
+// Report vertex normals per second on pools of 1 to 16 threads, and
+// speedup over one thread
+static void benchmarkVertexNormals(int size)
+{
+	TerrainGrid grid(size);
+	for (size_t i = 0; i < (size_t)size * size; i++)
+		grid.heights[i] = rand() % 1000 / 100.0;
+	GridRegion all = { 0, 0, size - 1, size - 1 };
+	grid.computeNormals(all, 1, 0);
+
+	double vertices = (double)size * size, single = 0;
+	printf("\nVertex normals on %d x %d grid (%d cores):\n", size, size,
+		(int)std::thread::hardware_concurrency());
+	printf("%-8s %10s %18s %8s\n", "threads", "time (ms)", "M vertices/s",
+		"speedup");
+	for (int threads = 1; threads <= 16; threads *= 2)
+	{
+		// Best of several passes to reduce noise
+		ThreadPool pool(threads);
+		double best = 0;
+		for (int pass = 0; pass < 3; pass++)
+		{
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			grid.computeVertexNormals(all, 1, &pool);
+			double time = elapsed(start);
+			if (pass == 0 || time < best)
+				best = time;
+		}
+		if (threads == 1)
+			single = best;
+		printf("%-8d %10.1f %18.1f %8.2f\n", threads, best,
+			vertices / best / 1000, single / best);
+	}
+}
+
+// Report vertex colors per second for scalar and vectorized kernels
+static void benchmarkColors(int size)
+{
+	TerrainGrid grid(size);
+	for (size_t i = 0; i < (size_t)size * size; i++)
+		grid.heights[i] = rand() % 1000 / 100.0;
+	grid.findGreatestHeight();
+	GridRegion all = { 0, 0, size - 1, size - 1 };
+	float lowColor[] = { 0.150, 0.150, 0.000 };
+	float highColor[] = { 0.000, 0.500, 0.000 };
+
+	double vertices = (double)size * size;
+	std::vector<uint32_t> scalar;
+	printf("\nVertex colors on %d x %d grid:\n", size, size);
+	for (int useSimd = 0; useSimd <= 1; useSimd++)
+	{
+		// Best of several passes to reduce noise
+		double best = 0;
+		for (int pass = 0; pass < 5; pass++)
+		{
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			grid.computeColors(all, lowColor, highColor, useSimd);
+			double time = elapsed(start);
+			if (pass == 0 || time < best)
+				best = time;
+		}
+		printf("%-8s %10.1f ms %12.1f M vertices/s\n",
+			useSimd ? "simd" : "scalar", best, vertices / best / 1000);
+		if (!useSimd)
+			scalar.assign(grid.colors, grid.colors + size * size);
+	}
+
+	// Both kernels must agree
+	for (size_t i = 0; i < scalar.size(); i++)
+	{
+		if (scalar[i] != grid.colors[i])
+		{
+			printf("Mismatch between scalar and simd colors.\n");
+			failedChecks++;
+			break;
+		}
+	}
+}
+
+// Report save and load times of height map files in both formats, and
+// how far loaded heights are from saved ones
+static void benchmarkHeightMaps(int size)
+{
+	TerrainGrid grid(size);
+	TerrainGenerator *generator = TerrainGenerator::create("diamond");
+	generator->generate(grid, 1);
+	delete generator;
+
+	const char *path = "benchmark.hmap";
+	const char *formats[] = { "float32", "uint16" };
+	printf("\nHeight map files (%d x %d):\n", size, size);
+	printf("%-8s %10s %10s %10s %12s %12s\n", "format", "size (MB)",
+		"save (ms)", "open (ms)", "first (ms)", "max error");
+	for (int format = HEIGHTS_FLOAT32; format <= HEIGHTS_UINT16; format++)
+	{
+		// Time writing file
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		if (!HeightMap::save(path, grid, (HeightMapFormat)format))
+			return;
+		double saveTime = elapsed(start);
+
+		// Time opening file as grid, then first pass over every height
+		HeightMap map;
+		start = std::chrono::steady_clock::now();
+		if (!map.open(path))
+			return;
+		TerrainGrid *loaded = map.createGrid();
+		double openTime = elapsed(start);
+		start = std::chrono::steady_clock::now();
+		loaded->findGreatestHeight();
+		double firstTime = elapsed(start);
+
+		// Largest difference to saved heights
+		float error = 0;
+		for (size_t i = 0; i < (size_t)size * size; i++)
+			error = fmax(error, fabs(loaded->heights[i] - grid.heights[i]));
+
+		printf("%-8s %10.1f %10.1f %10.1f %12.1f %12.5f\n", formats[format],
+			(4096 + (size_t)size * size * (format == HEIGHTS_FLOAT32 ? 4 : 2))
+				/ 1048576.0, saveTime, openTime, firstTime, error);
+		delete loaded;
+	}
+	remove(path);
+}
+
+// Points inside regions
+static long regionPoints(const std::vector<GridRegion> &regions)
+{
+	long points = 0;
+	for (size_t i = 0; i < regions.size(); i++)
+		points += (long)(regions[i].maxX - regions[i].minX + 1)
+			* (regions[i].maxZ - regions[i].minZ + 1);
+	return points;
+}
+
+// Report time to apply a fast diagonal brush stroke across the grid stamp
+// by stamp (normals refreshed after each), as one batch over a box around
+// the whole stroke (normals refreshed once for it), and as clusters of
+// overlapping stamps each applied over its own region (normals refreshed
+// once for disjoint regions of clusters), and check all give the same
+// heights
+static void benchmarkBrush(int size)
+{
+	// Stamps of mouse brush every eighth of its size along diagonal
+	float brushSize = size / 5, spacing = brushSize / 8;
+	std::vector<Circle> stroke;
+	for (float t = 0; t < size; t += spacing)
+	{
+		Circle stamp = { t, t, brushSize, size / 50 * 0.25f };
+		stroke.push_back(stamp);
+	}
+
+	printf("\nBrush stroke of %d stamps on %d x %d grid:\n",
+		(int)stroke.size(), size, size);
+	printf("%-10s %10s %9s %14s\n", "apply", "time (ms)", "regions",
+		"points (M)");
+	TerrainGrid single(size), batched(size), clustered(size);
+	TerrainGenerator *generator = TerrainGenerator::create("circles");
+	generator->generate(single, 1);
+	generator->generate(batched, 1);
+	generator->generate(clustered, 1);
+	delete generator;
+
+	// Normals already exist when viewer is dragged, as after startup
+	GridRegion all = { 0, 0, size - 1, size - 1 };
+	single.computeNormals(all, 1, 1);
+	batched.computeNormals(all, 1, 1);
+	clustered.computeNormals(all, 1, 1);
+
+	// Stamp by stamp, as mouse clicks were applied
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	std::vector<GridRegion> regions;
+	for (size_t i = 0; i < stroke.size(); i++)
+	{
+		regions.push_back(single.addCircle(stroke[i].x, stroke[i].z,
+			stroke[i].size, stroke[i].displacement));
+		single.computeNormals(regions.back(), 1, 1);
+	}
+	double time = elapsed(start);
+	printf("%-10s %10.1f %9d %14.2f\n", "single", time, (int)regions.size(),
+		regionPoints(regions) / 1e6);
+
+	// One batch over box around whole stroke
+	start = std::chrono::steady_clock::now();
+	regions.assign(1, batched.addCircles(stroke));
+	batched.computeNormals(regions[0], 1, 1);
+	time = elapsed(start);
+	printf("%-10s %10.1f %9d %14.2f\n", "box", time, (int)regions.size(),
+		regionPoints(regions) / 1e6);
+
+	// Clusters queued as mouse drags queue them, regions kept disjoint
+	start = std::chrono::steady_clock::now();
+	std::vector<CircleCluster> clusters;
+	for (size_t i = 0; i < stroke.size(); i++)
+		clustered.clusterCircle(clusters, stroke[i]);
+	regions.clear();
+	for (size_t i = 0; i < clusters.size(); i++)
+		addDisjointRegion(regions, clustered.addCircles(clusters[i].circles));
+	for (size_t i = 0; i < regions.size(); i++)
+		clustered.computeNormals(regions[i], 1, 1);
+	time = elapsed(start);
+	printf("%-10s %10.1f %9d %14.2f (%d clusters)\n", "clusters", time,
+		(int)regions.size(), regionPoints(regions) / 1e6,
+		(int)clusters.size());
+
+	float batchError = 0, clusterError = 0;
+	for (size_t i = 0; i < (size_t)size * size; i++)
+	{
+		batchError = fmax(batchError,
+			fabs(single.heights[i] - batched.heights[i]));
+		clusterError = fmax(clusterError,
+			fabs(single.heights[i] - clustered.heights[i]));
+	}
+	printf("Max difference from single: box %g, clusters %g\n",
+		batchError, clusterError);
+}
+
+// Report time of every post-process filter on one thread and on all cores,
+// and check that both give the same heights
+static void benchmarkFilters(int size)
+{
+	int cores = std::thread::hardware_concurrency();
+	ThreadPool single(1), several(cores > 0 ? cores : 1);
+
+	printf("\nFilters on %d x %d grid (%d cores):\n", size, size, cores);
+	printf("%-10s %12s %14s %14s\n", "filter", "scratch (MB)",
+		"1 thread (ms)", "all cores (ms)");
+	for (int i = 0; TerrainFilter::names[i] != NULL; i++)
+	{
+		TerrainFilter *filter = TerrainFilter::create(TerrainFilter::names[i]);
+		TerrainGrid first(size), second(size);
+		first.generateCircles(1, &several);
+		second.generateCircles(1, &several);
+
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		filter->apply(first, &single);
+		double singleTime = elapsed(start);
+		start = std::chrono::steady_clock::now();
+		filter->apply(second, &several);
+		double severalTime = elapsed(start);
+
+		printf("%-10s %12.1f %14.1f %14.1f%s\n", filter->name(),
+			filter->scratchBytes(size) / 1048576.0, singleTime, severalTime,
+			first.hash() != second.hash() ? " MISMATCH between thread counts"
+			: "");
+		if (first.hash() != second.hash())
+			failedChecks++;
+		delete filter;
+	}
+}
+
+// Check that every filter leaves flat grids at, below and above zero
+// unchanged (no slope to smooth, slide or erode along)
+static void verifyFlatFilters()
+{
+	const float levels[] = { 0, -3, 5 };
+	printf("\nFilters on flat 64 x 64 grids:\n");
+	for (int i = 0; TerrainFilter::names[i] != NULL; i++)
+	{
+		TerrainFilter *filter = TerrainFilter::create(TerrainFilter::names[i]);
+		float error = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			TerrainGrid grid(64);
+			for (size_t k = 0; k < (size_t)64 * 64; k++)
+				grid.heights[k] = levels[j];
+			grid.findGreatestHeight();
+			filter->apply(grid);
+
+			// NaN never compares equal, so it counts as infinite error
+			for (size_t k = 0; k < (size_t)64 * 64; k++)
+			{
+				float difference = fabs(grid.heights[k] - levels[j]);
+				error = difference == difference ? fmax(error, difference)
+					: INFINITY;
+			}
+		}
+		printf("%-10s max change %g %s\n", filter->name(), error,
+			error <= 1e-4 ? "ok" : "MISMATCH with flat grid");
+		if (!(error <= 1e-4))
+			failedChecks++;
+		delete filter;
+	}
+}
+
+// Height of terrain surface at grid position, on triangles split along
+// each cell's (x, z) to (x + 1, z + 1) diagonal as drawn
+static float surfaceHeight(TerrainGrid &grid, float x, float z)
+{
+	int cx = std::min((int)x, grid.size - 2);
+	int cz = std::min((int)z, grid.size - 2);
+	float fx = x - cx, fz = z - cz;
+	float h00 = grid.height(cx, cz), h11 = grid.height(cx + 1, cz + 1);
+	if (fx >= fz)
+		return h00 + fx * (grid.height(cx + 1, cz) - h00)
+			+ fz * (h11 - grid.height(cx + 1, cz));
+	return h00 + fz * (grid.height(cx, cz + 1) - h00)
+		+ fx * (h11 - grid.height(cx, cz + 1));
+}
+
+// Report time to build picking quadtree and cast rays from camera
+// positions around terrain, and check hits against marching each ray in
+// small steps (hit must be on surface with no point of ray below it
+// before)
+static void benchmarkPicking(int size)
+{
+	TerrainGrid grid(size);
+	grid.generateCircles(1);
+	grid.findGreatestHeight();
+	TerrainPicker picker(size);
+	GridRegion all = { 0, 0, size - 1, size - 1 };
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	picker.update(grid, all);
+	double buildTime = elapsed(start);
+
+	// Rays from a sphere of grid size around center towards random points
+	// within grid, as camera window would cast them
+	const int rays = 1000;
+	float center = (size - 1) / 2.0;
+	double total = 0, worst = 0;
+	long nodes = 0, triangles = 0;
+	int hits = 0, errors = 0;
+	srand(1);
+	for (int r = 0; r < rays; r++)
+	{
+		float tilt = (5 + rand() % 85) * M_PI / 180;
+		float turn = rand() % 360 * M_PI / 180;
+		float origin[3] = { center + size * cosf(tilt) * sinf(turn),
+			size * sinf(tilt), center + size * cosf(tilt) * cosf(turn) };
+		float target[3] = { (float)(rand() % size), grid.greatestHeight / 2,
+			(float)(rand() % size) };
+		float direction[3], hit[3];
+		for (int k = 0; k < 3; k++)
+			direction[k] = target[k] - origin[k];
+
+		start = std::chrono::steady_clock::now();
+		int found = picker.cast(grid, origin, direction, hit);
+		double time = elapsed(start);
+		total += time;
+		worst = fmax(worst, time);
+		nodes += picker.nodesVisited;
+		triangles += picker.trianglesTested;
+		hits += found;
+
+		// Every tenth ray checked by marching in steps of half a cell
+		if (r % 10 != 0)
+			continue;
+		float length = sqrtf(direction[0] * direction[0]
+			+ direction[1] * direction[1] + direction[2] * direction[2]);
+		float step = 0.5 / length, end = found ? (hit[1] - origin[1])
+			/ direction[1] - step : 4;
+		int below = 0;
+		for (float t = step; t < end && !below; t += step)
+		{
+			float x = origin[0] + t * direction[0];
+			float z = origin[2] + t * direction[2];
+			if (x >= 0 && x <= size - 1 && z >= 0 && z <= size - 1)
+				below = origin[1] + t * direction[1]
+					< surfaceHeight(grid, x, z) - 1e-3;
+		}
+		if (below || (found && fabs(hit[1] - surfaceHeight(grid, hit[0],
+			hit[2])) > 1e-2))
+			errors++;
+	}
+
+	printf("\nPicking on %d x %d grid (%d levels):\n", size, size,
+		picker.levels);
+	printf("%-24s %10.1f ms\n", "build quadtree", buildTime);
+	printf("%-24s %10.1f us (worst %.1f us)\n", "cast ray",
+		total / rays * 1000, worst * 1000);
+	printf("%-24s %10.1f nodes, %.1f triangles\n", "visited per ray",
+		(double)nodes / rays, (double)triangles / rays);
+	printf("%-24s %10d of %d (%d wrong)\n", "hits", hits, rays, errors);
+}
+
+// Check that fixed seeds still give the same height maps, both on one
+// thread and split across several
+static void verifySeeds()
+{
+	// Hashes of 512 x 512 terrains for seeds 1 to 3
+	const uint64_t expected[] =
+	{
+		0x97f3a4ca47b7d886ULL, 0x15a839547e580b77ULL, 0x59748282f38316e9ULL
+	};
+	ThreadPool single(1), several(4);
+
+	printf("\nSeeded terrain hashes (512 x 512):\n");
+	for (int i = 0; i < 3; i++)
+	{
+		TerrainGrid first(512), second(512);
+		first.generateCircles(i + 1, &single);
+		second.generateCircles(i + 1, &several);
+		printf("seed %d: %016llx %s\n", i + 1,
+			(unsigned long long)first.hash(),
+			first.hash() != second.hash() ? "MISMATCH between thread counts"
+			: first.hash() != expected[i] ? "MISMATCH with expected hash"
+			: "ok");
+		if (first.hash() != second.hash() || first.hash() != expected[i])
+			failedChecks++;
+	}
+}
+
+// Main function: run benchmarks for grid sizes given in command line,
+// exit status is nonzero if any correctness check failed
+int main(int argc, char **argv)
+{
+	// Default grid sizes if none given
+	std::vector<int> sizes;
+	for (int i = 1; i < argc; i++)
+		sizes.push_back(atoi(argv[i]));
+	if (sizes.empty())
+		sizes = { 256, 512, 1024, 2048 };
+
+	benchmarkGeneration(sizes);
+	benchmarkNormals(4096);
+	benchmarkColors(4096);
+	benchmarkVertexNormals(8192);
+	benchmarkHeightMaps(4096);
+	benchmarkBrush(2048);
+	benchmarkFilters(1024);
+	verifyFlatFilters();
+	benchmarkPicking(4096);
+	verifySeeds();
+
+	// Fail so scripts running benchmarks notice broken results
+	if (failedChecks > 0)
+	{
+		printf("\n%d checks failed.\n", failedChecks);
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
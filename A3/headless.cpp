@@ -0,0 +1,148 @@
+// Standard C++ library imports
+#define GL_GLEXT_PROTOTYPES
+#include <stdio.h>
+#include <vector>
+
+// OpenGL and EGL imports (headless rendering supported on Linux only)
+#ifdef __linux__
+#  include <EGL/egl.h>
+#  include <EGL/eglext.h>
+#  include <GL/gl.h>
+#  include <GL/glext.h>
+#endif
+
+// Local imports
+#include "headless.h"
+
+#ifdef __linux__
+
+// Display shared by all contexts, initialized on first use
+static EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+
+// Open surfaceless display, returns 0 if unavailable
+static int openDisplay()
+{
+	if (headlessDisplay != EGL_NO_DISPLAY)
+		return 1;
+
+	// Surfaceless platform needs no window system or GPU
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay == NULL)
+		return 0;
+	EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+		EGL_DEFAULT_DISPLAY, NULL);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+		return 0;
+
+	// Desktop OpenGL for fixed-function pipeline used by terrain
+	if (!eglBindAPI(EGL_OPENGL_API))
+		return 0;
+	headlessDisplay = display;
+	return 1;
+}
+
+// Constructor: create context with color and depth renderbuffers
+HeadlessContext::HeadlessContext(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	context = NULL;
+	framebuffer = 0;
+	if (!openDisplay())
+		return;
+
+	// Context without config or surface, draws only into framebuffer
+	EGLContext created = eglCreateContext(headlessDisplay,
+		EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, NULL);
+	if (created == EGL_NO_CONTEXT)
+		return;
+	context = created;
+	makeCurrent();
+
+	// Color and depth attachments sized like a window
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_RENDERBUFFER, renderbuffers[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+		width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+		GL_RENDERBUFFER, renderbuffers[1]);
+
+	// Give up on incomplete framebuffer
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			EGL_NO_CONTEXT);
+		eglDestroyContext(headlessDisplay, context);
+		context = NULL;
+	}
+}
+
+// Destructor
+HeadlessContext::~HeadlessContext()
+{
+	if (context == NULL)
+		return;
+	makeCurrent();
+	glDeleteRenderbuffers(2, renderbuffers);
+	glDeleteFramebuffers(1, &framebuffer);
+	eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+		EGL_NO_CONTEXT);
+	eglDestroyContext(headlessDisplay, context);
+}
+
+// Make context current so following GL calls draw into it
+void HeadlessContext::makeCurrent()
+{
+	eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+		context);
+}
+
+// Write framebuffer contents to binary PPM file, returns 0 on failure
+int HeadlessContext::savePPM(const char *path)
+{
+	// Read rows bottom to top as OpenGL stores them
+	std::vector<unsigned char> pixels((size_t)width * height * 3);
+	makeCurrent();
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE,
+		pixels.data());
+
+	// Write rows top to bottom as PPM expects
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+		return 0;
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (int y = height - 1; y >= 0; y--)
+		fwrite(&pixels[(size_t)y * width * 3], 1, width * 3, file);
+	return fclose(file) == 0;
+}
+
+#else
+
+// Headless rendering is unavailable without EGL
+HeadlessContext::HeadlessContext(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	context = NULL;
+	framebuffer = 0;
+}
+HeadlessContext::~HeadlessContext() {}
+void HeadlessContext::makeCurrent() {}
+int HeadlessContext::savePPM(const char *path) { return 0; }
+
+#endif
+
+// Check whether context was created, rendering is impossible if not
+int HeadlessContext::valid()
+{
+	return context != NULL;
+}
@@ -0,0 +1,28 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Offscreen OpenGL context rendering into a framebuffer object instead of
+// a window, for machines without a display (EGL surfaceless platform,
+// e.g. Mesa llvmpipe, Linux only)
+class HeadlessContext
+{
+public:
+	HeadlessContext(int width, int height); // Framebuffer size in pixels
+	~HeadlessContext(); // Destructor
+
+	// Check whether context was created, rendering is impossible if not
+	int valid();
+
+	// Make context current so following GL calls draw into it
+	void makeCurrent();
+
+	// Write framebuffer contents to binary PPM file, returns 0 on failure
+	int savePPM(const char *path);
+
+private:
+	int width, height;
+	void *context;
+	unsigned int framebuffer, renderbuffers[2];
+};
+
+#endif
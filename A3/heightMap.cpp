@@ -0,0 +1,279 @@
+// Standard C++ library imports
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Local imports
+#include "heightMap.h"
+#include "threadPool.h"
+
+// Magic bytes and version of binary height map files
+static const char heightMapMagic[4] = { 'A', '3', 'H', 'M' };
+static const uint32_t heightMapVersion = 1;
+
+// Samples start on first page boundary after header
+static const uint64_t heightMapAlignment = 4096;
+
+// Bytes per sample of format
+static size_t sampleBytes(uint32_t format)
+{
+	return format == HEIGHTS_UINT16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+// Constructor
+HeightMap::HeightMap()
+{
+	memset(&header, 0, sizeof(header));
+	mapping = NULL;
+	mappingSize = 0;
+}
+
+// Destructor, unmaps file
+HeightMap::~HeightMap()
+{
+	if (mapping != NULL)
+		munmap(mapping, mappingSize);
+}
+
+// Map file, returns 0 and prints reason on failure
+int HeightMap::open(const char *path)
+{
+	// Size of whole file for mapping
+	int file = ::open(path, O_RDONLY);
+	struct stat status;
+	if (file < 0 || fstat(file, &status) != 0)
+	{
+		printf("Could not open height map %s.\n", path);
+		if (file >= 0)
+			close(file);
+		return 0;
+	}
+	if ((size_t)status.st_size < sizeof(header))
+	{
+		printf("Height map %s is too short.\n", path);
+		close(file);
+		return 0;
+	}
+
+	// Private writable mapping, so terrain edits copy pages in memory
+	// instead of changing file
+	mappingSize = status.st_size;
+	mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		file, 0);
+	close(file);
+	if (mapping == MAP_FAILED)
+	{
+		printf("Could not map height map %s.\n", path);
+		mapping = NULL;
+		return 0;
+	}
+
+	// Only square maps of known version and format are supported
+	memcpy(&header, mapping, sizeof(header));
+	const char *problem = NULL;
+	if (memcmp(header.magic, heightMapMagic, sizeof(heightMapMagic)) != 0)
+		problem = "not a height map";
+	else if (header.version != heightMapVersion)
+		problem = "unsupported version";
+	else if (header.format != HEIGHTS_FLOAT32
+		&& header.format != HEIGHTS_UINT16)
+		problem = "unknown sample format";
+	else if (header.width != header.depth || header.width < 2)
+		problem = "not a square grid";
+	else if (header.dataOffset % heightMapAlignment != 0
+		|| header.dataOffset + (uint64_t)header.width * header.depth
+		* sampleBytes(header.format) > mappingSize)
+		problem = "samples missing";
+	if (problem != NULL)
+	{
+		printf("Could not load height map %s: %s.\n", path, problem);
+		munmap(mapping, mappingSize);
+		mapping = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+// Grid of mapped heights, float samples are used in place (untouched
+// until first read) and 16-bit samples converted in parallel
+TerrainGrid *HeightMap::createGrid()
+{
+	TerrainGrid *grid;
+	char *samples = (char*)mapping + header.dataOffset;
+	if (header.format == HEIGHTS_FLOAT32)
+		grid = new TerrainGrid(header.width, (float*)samples);
+	else
+	{
+		grid = new TerrainGrid(header.width);
+		uint16_t *values = (uint16_t*)samples;
+		ThreadPool::shared().forRows(grid->size, [&](int first, int last)
+		{
+			for (size_t i = grid->index(first, 0);
+				i < grid->index(last + 1, 0); i++)
+				grid->heights[i] = header.offset + values[i] * header.scale;
+		});
+	}
+	grid->seed = header.seed;
+	grid->greatestHeight = header.greatestHeight;
+	return grid;
+}
+
+// Write grid to binary height map file in given format, returns 0 and
+// prints reason on failure
+int HeightMap::save(const char *path, TerrainGrid &grid,
+	HeightMapFormat format)
+{
+	size_t points = (size_t)grid.size * grid.size;
+
+	// 16-bit samples span range of heights, floats are stored as they are
+	HeightMapHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, heightMapMagic, sizeof(heightMapMagic));
+	header.version = heightMapVersion;
+	header.format = format;
+	header.width = header.depth = grid.size;
+	header.scale = 1;
+	header.offset = 0;
+	header.seed = grid.seed;
+	header.greatestHeight = grid.greatestHeight;
+	header.dataOffset = heightMapAlignment;
+	if (format == HEIGHTS_UINT16)
+	{
+		float lowest = grid.heights[0], highest = grid.heights[0];
+		for (size_t i = 0; i < points; i++)
+		{
+			lowest = grid.heights[i] < lowest ? grid.heights[i] : lowest;
+			highest = grid.heights[i] > highest ? grid.heights[i] : highest;
+		}
+		header.offset = lowest;
+		header.scale = highest > lowest ? (highest - lowest) / 65535 : 1;
+	}
+
+	// Header padded to page boundary
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		printf("Could not create height map %s.\n", path);
+		return 0;
+	}
+	std::vector<char> padding(heightMapAlignment, 0);
+	memcpy(padding.data(), &header, sizeof(header));
+	int written = fwrite(padding.data(), 1, padding.size(), file)
+		== padding.size();
+
+	// Samples a row at a time, rounded to nearest 16-bit value
+	std::vector<uint16_t> row(grid.size);
+	for (int x = 0; written && x < grid.size; x++)
+	{
+		float *heights = &grid.heights[grid.index(x, 0)];
+		if (format == HEIGHTS_FLOAT32)
+		{
+			written = fwrite(heights, sizeof(float), grid.size, file)
+				== (size_t)grid.size;
+			continue;
+		}
+		for (int z = 0; z < grid.size; z++)
+			row[z] = (heights[z] - header.offset) / header.scale + 0.5f;
+		written = fwrite(row.data(), sizeof(uint16_t), grid.size, file)
+			== (size_t)grid.size;
+	}
+	if (fclose(file) != 0 || !written)
+	{
+		printf("Could not write height map %s.\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+// Read next number in PGM header, skipping whitespace and comments
+static int readPGMNumber(FILE *file)
+{
+	int c = fgetc(file);
+	while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+	{
+		if (c == '#')
+			while (c != '\n' && c != EOF)
+				c = fgetc(file);
+		c = fgetc(file);
+	}
+	int number = -1;
+	while (c >= '0' && c <= '9')
+	{
+		number = (number < 0 ? 0 : number * 10) + c - '0';
+		c = fgetc(file);
+	}
+	return number;
+}
+
+// Check whether file starts like a PGM image
+int HeightMap::isPGM(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return 0;
+	char magic[2] = { 0, 0 };
+	size_t read = fread(magic, 1, 2, file);
+	fclose(file);
+	return read == 2 && magic[0] == 'P' && magic[1] == '5';
+}
+
+// Read binary 8 or 16-bit PGM image as grid (cropped to square), brightest
+// value becomes relief times points per side
+TerrainGrid *HeightMap::importPGM(const char *path, float relief)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		printf("Could not open image %s.\n", path);
+		return NULL;
+	}
+
+	// Header of width, height and greatest value, then one whitespace
+	// character before samples
+	char magic[2];
+	int width = -1, height = -1, maxValue = -1;
+	if (fread(magic, 1, 2, file) == 2 && magic[0] == 'P' && magic[1] == '5')
+	{
+		width = readPGMNumber(file);
+		height = readPGMNumber(file);
+		maxValue = readPGMNumber(file);
+	}
+	if (width < 2 || height < 2 || maxValue < 1 || maxValue > 65535)
+	{
+		printf("Image %s is not a binary PGM height map.\n", path);
+		fclose(file);
+		return NULL;
+	}
+
+	// Rows of image become rows of grid, extra rows or columns are cropped
+	int size = width < height ? width : height;
+	int bytes = maxValue > 255 ? 2 : 1;
+	float top = relief * size;
+	TerrainGrid *grid = new TerrainGrid(size);
+	std::vector<unsigned char> row((size_t)width * bytes);
+	for (int x = 0; x < size; x++)
+	{
+		if (fread(row.data(), 1, row.size(), file) != row.size())
+		{
+			printf("Image %s is missing samples.\n", path);
+			fclose(file);
+			delete grid;
+			return NULL;
+		}
+
+		// 16-bit samples are stored most significant byte first
+		float *heights = &grid->heights[grid->index(x, 0)];
+		for (int z = 0; z < size; z++)
+		{
+			int value = bytes == 2 ? row[z * 2] << 8 | row[z * 2 + 1] : row[z];
+			heights[z] = (float)value / maxValue * top;
+		}
+	}
+	fclose(file);
+	grid->findGreatestHeight();
+	return grid;
+}
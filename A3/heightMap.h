@@ -0,0 +1,75 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "terrainGrid.h"
+
+// Sample formats of binary height map
+enum HeightMapFormat { HEIGHTS_FLOAT32 = 0, HEIGHTS_UINT16 = 1 };
+
+// Header at start of binary height map file, samples follow row-major (x
+// by z) at data offset, which is page aligned so samples can be mapped
+// and used in place; height = offset + sample * scale, greatest height is
+// stored so loading need not scan samples
+struct HeightMapHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint32_t width, depth;
+	float scale, offset;
+	float greatestHeight;
+	uint64_t seed;
+	uint64_t dataOffset;
+};
+
+// Binary height map file mapped into memory, pages are read from disk on
+// first access
+class HeightMap
+{
+public:
+	HeightMap(); // Constructor
+	~HeightMap(); // Destructor, unmaps file
+
+	HeightMapHeader header;
+
+	// Map file, returns 0 and prints reason on failure
+	int open(const char *path);
+
+	// Height at grid point read straight from mapped samples, for maps
+	// too large for a grid
+	float height(int x, int z) const
+	{
+		size_t i = (size_t)x * header.depth + z;
+		const char *samples = (const char*)mapping + header.dataOffset;
+		return header.format == HEIGHTS_UINT16
+			? header.offset + ((const uint16_t*)samples)[i] * header.scale
+			: ((const float*)samples)[i];
+	}
+
+	// Grid of mapped heights, float samples are used in place (changes
+	// stay in memory and never reach file) and 16-bit samples converted
+	// in parallel, map must outlive grid
+	TerrainGrid *createGrid();
+
+	// Write grid to binary height map file in given format, returns 0 and
+	// prints reason on failure
+	static int save(const char *path, TerrainGrid &grid,
+		HeightMapFormat format);
+
+	// Read binary 8 or 16-bit PGM image as grid (cropped to square),
+	// brightest value becomes relief times points per side, NULL on
+	// failure
+	static TerrainGrid *importPGM(const char *path, float relief);
+
+	// Check whether file starts like a PGM image
+	static int isPGM(const char *path);
+
+private:
+	void *mapping;
+	size_t mappingSize;
+};
+
+#endif
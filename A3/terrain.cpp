@@ -1,7 +1,13 @@
 // Standard C++ library imports
+#define GL_GLEXT_PROTOTYPES
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 
 // OpenGL and GLUT imports
 #ifdef __APPLE__
@@ -14,10 +20,22 @@
 #  include <GL/freeglut.h>
 #endif
 
+// Local imports
+#include "headless.h"
+#include "heightMap.h"
+#include "terrainChunks.h"
+#include "terrainFilter.h"
+#include "terrainGenerator.h"
+#include "terrainGrid.h"
+#include "terrainMesh.h"
+#include "terrainPicker.h"
+#include "tileCache.h"
+
 // Values for window and grid size initialization
 static const int minGridSize = 50;
-static const int maxGridSize = 300;
+static const int maxGridSize = 16384;
 static const int windowSize = 600;
+static const int chunkSize = 64;
 static int secondDisplayWidth;
 static int secondDisplayHeight;
 
@@ -26,25 +44,75 @@ static float lowColor[] = { 0.150, 0.150, 0.000 };
 static float highColor[] = { 0.000, 0.500, 0.000 };
 static float wireColor[] = { 0.750, 0.750, 0.750 };
 
-// User-selected grid size
+// User-selected grid size and seed for terrain generation
 static int gridSize = 0;
-
-// Height map for points on terrain
-float heightMap[maxGridSize][maxGridSize];
-
-// Normal map for squares, triangles pointing to x and z axes, and vertices
-float squareNormals[maxGridSize][maxGridSize][3];
-float triangleXNormals[maxGridSize][maxGridSize][3];
-float triangleZNormals[maxGridSize][maxGridSize][3];
-float vertexNormals[maxGridSize][maxGridSize][3];
-enum NormalType { SQUARE, TRIANGLEX, TRIANGLEZ, VERTEX };
-
-// Global value for tallest height in current terrain
-static float greatestHeight;
+static uint64_t terrainSeed = 0;
+
+// Terrain grid with height and normal maps, sized to grid size
+static TerrainGrid *terrain = NULL;
+
+// Algorithm used for new terrains, selected at startup
+static TerrainGenerator *generator = NULL;
+
+// Post-process passes applied in order to every new terrain, selected at
+// startup
+static std::vector<TerrainFilter*> filters;
+
+// Mapped height map file when terrain was loaded from one
+static HeightMap *heightMap = NULL;
+
+// File and sample format for exporting terrain
+static const char *exportPath = "terrain.hmap";
+static HeightMapFormat exportFormat = HEIGHTS_FLOAT32;
+
+// Tile cache when streaming tiled terrain instead of holding a grid
+// (--stream), its budget and tiles loaded when last frame was drawn
+static TileCache *tileCache = NULL;
+static size_t cacheBudget = (size_t)256 << 20;
+static unsigned long tilesCompleted = 0;
+
+// Tiles chosen for current frame of first window
+static std::vector<const Tile*> drawnTiles;
+
+// Height quadtree for picking terrain under cursor in first window, regions
+// with stale bounds and counts of picks and their time for statistics
+static TerrainPicker *picker = NULL;
+static std::vector<GridRegion> pickDirty;
+static int picksCast = 0;
+static double pickTimeTotal = 0;
+
+// Regions with stale normals and counts of recomputes for statistics
+static std::vector<GridRegion> dirtyRegions;
+static int normalRecomputes = 0;
+static long normalCellsUpdated = 0;
+
+// Brush stamps queued by mouse since last frame, grouped into clusters of
+// overlapping stamps applied once per frame, and counts of stamps, batches
+// and clusters applied for statistics
+static std::vector<CircleCluster> brushStamps;
+static int stampsApplied = 0;
+static int stampBatches = 0;
+static int stampClusters = 0;
+
+// Mouse button held down on either window (-1 if none) and grid point
+// of last stamp of its stroke
+static int brushButton = -1;
+static float brushX = 0, brushZ = 0;
+
+// Whether rendering offscreen without windows (--headless)
+static int headless = 0;
+
+// Time of last statistics report printed to command line
+static std::chrono::steady_clock::time_point lastReport =
+	std::chrono::steady_clock::now();
 
 // Position of camera rotation around x/y axis
 static float cameraRotationX = 15, cameraRotationY = 0;
 
+// Distance of camera from center of terrain, grid size unless zoomed in
+static float cameraDistance = 0;
+static const float maxZoom = 16;
+
 // Enum definition and global variable for wireframe mode
 enum WireframeMode { SOLID, WIREFRAME, BOTH };
 WireframeMode wireframeMode = SOLID;
@@ -61,186 +129,282 @@ LightingMode lightingMode = SOURCE1;
 enum ShadingMode { FLAT, GOURAUD };
 ShadingMode shadingMode = FLAT;
 
-// Calculate polygon face normal given 3 x/z coordinates
-void calculateFaceNormal(int x1, int z1, int x2, int z2,
-	int x3, int z3, NormalType n)
+// Enum definition and global variable for render path
+enum RenderMode { MESH, IMMEDIATE };
+RenderMode renderMode = MESH;
+
+// Enum definition and global variable for view-frustum culling
+enum CullingMode { CULL, NO_CULL };
+CullingMode cullingMode = CULL;
+
+// Enum definition and global variable for chunk level of detail
+enum DetailMode { FULL_DETAIL, LEVEL_OF_DETAIL };
+DetailMode detailMode = FULL_DETAIL;
+
+// Terrain chunks culled against view of first window
+static TerrainChunks *chunks = NULL;
+
+// Retained terrain mesh built per visible chunk at its level of detail
+// within a memory budget (--mesh-mb), and strip ranges of a full detail
+// chunk
+static TerrainMesh *terrainMesh = NULL;
+static size_t meshBudget = defaultMeshBudget;
+static GLint stripFirsts[chunkSize];
+static GLsizei stripCounts[chunkSize];
+
+// Screen-space error allowed when choosing chunk detail levels (pixels)
+static float pixelError = 2;
+static const float minPixelError = 0.25;
+static const float maxPixelError = 64;
+
+// Cached top-down color map for second window, texel (s, t) holds grid
+// point (t * step, s * step), sampled so texture stays within size limit
+static GLuint overviewTexture = 0;
+static int overviewSize = 0;
+static int overviewStep = 1;
+static const int maxOverviewSize = 2048;
+
+// Regions with stale overview colors and greatest height used for them
+static std::vector<GridRegion> overviewDirty;
+static float overviewGreatestHeight = -1;
+
+// Regions with stale point colors and greatest height used for them
+static std::vector<GridRegion> colorDirty;
+static float colorGreatestHeight = -1;
+
+// Greatest height used for mesh colors, rebuild all colors if it changes
+static float meshGreatestHeight = -1;
+
+// Accumulated render time of first window for statistics
+static double frameTimeTotal = 0;
+static int frameCount = 0;
+
+// GLUT ids of both windows and whether each needs redrawing
+static int windowIds[2];
+static int windowDirty[2] = { 1, 1 };
+
+// Frame rate cap of redraw scheduler (0 for none), and frames rendered and
+// skipped by scheduler for statistics
+static int fpsCap = 60;
+static int framesRendered = 0;
+static int framesSkipped = 0;
+
+// Accumulated visible chunks and triangles of first window for statistics
+static long visibleChunkTotal = 0;
+static long visibleTriangleTotal = 0;
+
+// Check whether region contains no grid points
+int regionEmpty(GridRegion region)
 {
-	// Vector a from point 2 to point 3
-	static float a[] =
-	{
-		x3 - x2,
-		heightMap[x3][z3] - heightMap[x2][z2],
-		z3 - z2
-	};
-
-	// Vector b from point 2 to point 1
-	static float b[] =
-	{
-		x1 - x2,
-		heightMap[x1][z1] - heightMap[x2][z2],
-		z1 - z2
-	};
-
-	// Vector c = a x b
-	static float c[] =
-	{
-		a[1] * b[2] - a[2] * b[1],
-		a[2] * b[0] - a[0] * b[2],
-		a[0] * b[1] - a[1] * b[0]
-	};
-
-	// Assign to respective normal map
-	if (n == SQUARE)
-		for (int i = 0; i < 3; i++)
-			squareNormals[x1][z1][i] = c[i];
-	if (n == TRIANGLEX)
-		for (int i = 0; i < 3; i++)
-			triangleXNormals[x1][z1][i] = c[i];
-	if (n == TRIANGLEZ)
-		for (int i = 0; i < 3; i++)
-			triangleZNormals[x1][z1][i] = c[i];
+	return region.minX > region.maxX || region.minZ > region.maxZ;
 }
 
-// Precompute normals depending on polygons and shading
-void precomputeNormals()
+// Grow target region to also cover given region
+void growRegion(GridRegion &target, GridRegion region)
 {
-	// Compute all face normals first
-	for (int x = 0; x < gridSize - 1; x++)
-	{
-		for (int z = 0; z < gridSize - 1; z++)
-		{
-			calculateFaceNormal(x, z, x, z + 1, x + 1, z + 1, SQUARE);
-			calculateFaceNormal(x, z, x + 1, z + 1, x + 1, z, TRIANGLEX);
-			calculateFaceNormal(x, z, x, z + 1, x + 1, z + 1, TRIANGLEZ);
-		}
-	}
-
-	// Skip vertex normal computation for flat shading
-	if (shadingMode == FLAT)
+	// Nothing to do for empty region
+	if (regionEmpty(region))
 		return;
 
-	// Compute vertex normals, assume upward face normals if outside grid
-	for (int x = 0; x < gridSize; x++)
+	// Replace empty target region, otherwise grow to cover both
+	if (regionEmpty(target))
+		target = region;
+	else
 	{
-		for (int z = 0; z < gridSize; z++)
-		{
-			// Accumulate normal, will be normalized by GL_NORMALIZE
-			float normal[3] = { 0, 0, 0 };
+		target.minX = fmin(target.minX, region.minX);
+		target.minZ = fmin(target.minZ, region.minZ);
+		target.maxX = fmax(target.maxX, region.maxX);
+		target.maxZ = fmax(target.maxZ, region.maxZ);
+	}
+}
 
-			// Different faces for squares
-			if (stripsMode == SQUARES)
-			{
-				// Square face at (x - 1, z - 1)
-				if (x >= 1 && z >= 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += squareNormals[x - 1][z - 1][i];
-				else
-					normal[1] += 1;
+// Stale regions are kept disjoint so each refresh only touches changed
+// points, past this many they are folded into one bounding region
+static const size_t maxStaleRegions = 64;
 
-				// Square face at (x, z - 1)
-				if (x < gridSize - 1 && z >= 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += squareNormals[x][z - 1][i];
-				else
-					normal[1] += 1;
+// Add region to list of stale regions
+void addStaleRegion(std::vector<GridRegion> &regions, GridRegion region)
+{
+	addDisjointRegion(regions, region);
+	if (regions.size() <= maxStaleRegions)
+		return;
+	GridRegion bounds = regions[0];
+	for (size_t i = 1; i < regions.size(); i++)
+		growRegion(bounds, regions[i]);
+	regions.assign(1, bounds);
+}
 
-				// Square face at (x - 1, z)
-				if (x >= 1 && z < gridSize - 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += squareNormals[x - 1][z][i];
-				else
-					normal[1] += 1;
+// Mark window (1 or 2) as needing to be redrawn by scheduler
+void requestRedraw(int window)
+{
+	windowDirty[window - 1] = 1;
 
-				// Square face at (x, z)
-				if (x < gridSize - 1 && z < gridSize - 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += squareNormals[x][z][i];
-				else
-					normal[1] += 1;
-			}
+	// Without frame rate cap, redraw as soon as GLUT is idle (once windows
+	// exist)
+	if (fpsCap == 0 && windowIds[window - 1] != 0)
+		glutPostWindowRedisplay(windowIds[window - 1]);
+}
 
-			//  Different faces for triangles
-			if (stripsMode == TRIANGLES)
-			{
-				// Triangle pointing to x axis at (x - 1, z - 1)
-				if (x >= 1 && z >= 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += triangleXNormals[x - 1][z - 1][i];
-				else
-					normal[1] += 1;
+// Timer function: redraw windows marked since last tick, at most once per
+// tick so frame rate stays within cap
+void scheduleRedraws(int /* value */)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (windowIds[i] == 0)
+			continue;
+		if (windowDirty[i])
+			glutPostWindowRedisplay(windowIds[i]);
+		else
+			framesSkipped++;
+	}
+	glutTimerFunc(1000 / fpsCap, scheduleRedraws, 0);
+}
 
-				// Triangle pointing to z axis at (x - 1, z - 1)
-				if (x >= 1 && z >= 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += triangleZNormals[x - 1][z - 1][i];
-				else
-					normal[1] += 1;
+// Mark normals in region as stale so they are recomputed before next draw
+void invalidateRegion(GridRegion region)
+{
+	addStaleRegion(dirtyRegions, region);
+	if (!regionEmpty(region))
+		requestRedraw(1);
+}
 
-				// Triangle pointing to z axis at (x, z - 1)
-				if (x < gridSize - 1 && z >= 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += triangleZNormals[x][z - 1][i];
-				else
-					normal[1] += 1;
+// Mark heights in region as changed, so normals, colors and overview are
+// updated before next draw
+void invalidateHeights(GridRegion region)
+{
+	invalidateRegion(region);
+	addStaleRegion(colorDirty, region);
+	addStaleRegion(overviewDirty, region);
+	addStaleRegion(pickDirty, region);
+	if (!regionEmpty(region))
+		requestRedraw(2);
+}
 
-				// Triangle pointing to x axis at (x - 1, z)
-				if (x >= 1 && z < gridSize - 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += triangleXNormals[x - 1][z][i];
-				else
-					normal[1] += 1;
+// Mark all normals as stale so they are recomputed before next draw
+void invalidateNormals()
+{
+	GridRegion all = { 0, 0, gridSize - 1, gridSize - 1 };
+	invalidateRegion(all);
+}
 
-				// Triangle pointing to x axis at (x, z)
-				if (x < gridSize - 1 && z < gridSize - 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += triangleXNormals[x][z][i];
-				else
-					normal[1] += 1;
+// Print statistics to command line at most once per second
+void reportStats()
+{
+	// Wait until a full second has passed since last report
+	std::chrono::steady_clock::time_point now =
+		std::chrono::steady_clock::now();
+	if (now - lastReport < std::chrono::seconds(1))
+		return;
 
-				// Triangle pointing to z axis at (x, z)
-				if (x < gridSize - 1 && z < gridSize - 1)
-					for (int i = 0; i < 3; i++)
-						normal[i] += triangleZNormals[x][z][i];
-				else
-					normal[1] += 1;
-			}
+	// Report frames drawn by scheduler and ticks where nothing changed
+	if (fpsCap > 0)
+		printf("Frames rendered: %d, skipped: %d (cap %d fps)\n",
+			framesRendered, framesSkipped, fpsCap);
+	else
+		printf("Frames rendered: %d (no fps cap)\n", framesRendered);
+
+	// Report average time to render a frame of first window
+	if (frameCount > 0)
+		printf("Average render time (%s): %.2f ms over %d frames\n",
+			renderMode == MESH ? "mesh" : "immediate",
+			frameTimeTotal / frameCount, frameCount);
+
+	// Report average culling results per frame of first window (squares
+	// count as two triangles)
+	if (frameCount > 0 && chunks != NULL)
+		printf("Visible per frame (%s, %s): %.1f of %d chunks,"
+			" %.0f triangles\n",
+			cullingMode == CULL ? "culled" : "not culled",
+			detailMode == LEVEL_OF_DETAIL ? "level of detail" : "full detail",
+			(double)visibleChunkTotal / frameCount, chunks->count,
+			(double)visibleTriangleTotal / frameCount);
+
+	// Report tiles drawn per frame and tile cache counters when streaming
+	if (frameCount > 0 && tileCache != NULL)
+		printf("Tiles per frame: %.1f, %.0f triangles\n",
+			(double)visibleChunkTotal / frameCount,
+			(double)visibleTriangleTotal / frameCount);
+	if (tileCache != NULL)
+	{
+		TileCacheStats stats = tileCache->statistics();
+		printf("Tile cache: %ld hits, %ld misses, %ld stalls (%.1f ms),"
+			" %ld loads, %ld evictions, %d of %d slots used\n",
+			stats.hits, stats.misses, stats.stalls, stats.stallTime,
+			stats.loads, stats.evictions, tileCache->resident(),
+			tileCache->capacity());
+	}
 
-			// Set value in vertex normal map
-			for (int i = 0; i < 3; i++)
-				vertexNormals[x][z][i] = normal[i];
-		}
+	// Only report when normals were actually recomputed
+	if (normalRecomputes > 0)
+		printf("Normal recomputes in last second: %d (%ld cells)\n",
+			normalRecomputes, normalCellsUpdated);
+
+	// Only report when chunk meshes were built, memory held by cached
+	// meshes against budget
+	if (terrainMesh != NULL && terrainMesh->verticesBuilt > 0)
+		printf("Mesh vertices built in last second: %ld (%ld chunks beyond"
+			" budget), %.1f of %.1f MB cached\n",
+			terrainMesh->verticesBuilt, terrainMesh->uncachedBuilds,
+			terrainMesh->bytes / 1048576.0,
+			terrainMesh->budget / 1048576.0);
+
+	// Only report when brush strokes were applied
+	if (stampBatches > 0)
+		printf("Brush stamps applied in last second: %d (%d batches, "
+			"%d clusters)\n", stampsApplied, stampBatches, stampClusters);
+
+	// Only report when terrain was picked in first window
+	if (picksCast > 0)
+		printf("Picks in last second: %d (avg %.3f ms)\n", picksCast,
+			pickTimeTotal / picksCast);
+
+	// Reset counters for next interval
+	stampsApplied = 0;
+	stampBatches = 0;
+	stampClusters = 0;
+	picksCast = 0;
+	pickTimeTotal = 0;
+	normalRecomputes = 0;
+	normalCellsUpdated = 0;
+	if (terrainMesh != NULL)
+	{
+		terrainMesh->verticesBuilt = 0;
+		terrainMesh->uncachedBuilds = 0;
 	}
+	frameTimeTotal = 0;
+	frameCount = 0;
+	framesRendered = 0;
+	framesSkipped = 0;
+	visibleChunkTotal = 0;
+	visibleTriangleTotal = 0;
+	lastReport = now;
 }
 
 // Draw a vertex at a given location
 void drawVertex(int x, int z, int wireframe, int window)
 {
-	// Compute height normalized wrt. highest point
-	float height = heightMap[x][z] / greatestHeight;
-
 	// Set color for wireframe
 	if (wireframe && window == 1)
 		glColor3fv(wireColor);
 
-	// Set color for solid shape
+	// Set color for solid shape from color map
 	else
-		glColor3f(
-			(lowColor[0] * (1 - height)
-				+ highColor[0] * (height)),
-			(lowColor[1] * (1 - height)
-				+ highColor[1] * (height)),
-			(lowColor[2] * (1 - height)
-				+ highColor[2] * (height)));
+		glColor4ubv(terrain->color(x, z));
 
 	// Set vertex normal to precomputed value for Gouraud shading
 	if (shadingMode == GOURAUD)
-		glNormal3fv(vertexNormals[x][z]);
+	{
+		float normal[3];
+		terrain->vertexNormal(x, z, normal);
+		glNormal3fv(normal);
+	}
 
 	// Draw vertex for first window (slightly higher for wireframe)
 	if (window == 1)
 		glVertex3f(
 			0 - (gridSize - 1) / 2 + x,
-			heightMap[x][z] + (wireframe ? 0.1 : 0),
+			terrain->height(x, z) + (wireframe ? 0.1 : 0),
 			0 - (gridSize - 1) / 2 + z);
 
 	// Draw vertex for second window
@@ -261,7 +425,11 @@ void drawSquareCell(int x, int z, int wireframe, int window)
 	// Draw square with calculated normals
 	glBegin(GL_QUADS);
 		if (shadingMode == FLAT)
-			glNormal3fv(squareNormals[x][z]);
+		{
+			float normal[3];
+			terrain->squareNormal(x, z, normal);
+			glNormal3fv(normal);
+		}
 		drawVertex(x, z, wireframe, window);
 		drawVertex(x, z + 1, wireframe, window);
 		drawVertex(x + 1, z + 1, wireframe, window);
@@ -281,7 +449,11 @@ void drawTriangleCell(int x, int z, int wireframe, int window)
 	// Draw first of two connected triangles with calculated normals
 	glBegin(GL_TRIANGLES);
 		if (shadingMode == FLAT)
-			glNormal3fv(triangleXNormals[x][z]);
+		{
+			float normal[3];
+			terrain->triangleXNormal(x, z, normal);
+			glNormal3fv(normal);
+		}
 		drawVertex(x, z, wireframe, window);
 		drawVertex(x + 1, z + 1, wireframe, window);
 		drawVertex(x + 1, z, wireframe, window);
@@ -290,121 +462,623 @@ void drawTriangleCell(int x, int z, int wireframe, int window)
 	// Draw second of two connected triangles with calculated normals
 	glBegin(GL_TRIANGLES);
 		if (shadingMode == FLAT)
-			glNormal3fv(triangleZNormals[x][z]);
+		{
+			float normal[3];
+			terrain->triangleZNormal(x, z, normal);
+			glNormal3fv(normal);
+		}
 		drawVertex(x, z, wireframe, window);
 		drawVertex(x, z + 1, wireframe, window);
 		drawVertex(x + 1, z + 1, wireframe, window);
 	glEnd();
 }
 
-// Draw terrain on first and second window
-void drawTerrain(int window)
+// Draw cells of visible chunks (all chunks on second window) one at a time
+void drawCells(int wireframe, int window)
 {
-	precomputeNormals();
-
-	// Iterate over all points first time
-	for (int x = 0; x < gridSize - 1; x++)
+	int total = window == 1 ? chunks->visibleCount : chunks->count;
+	for (int k = 0; k < total; k++)
 	{
-		for (int z = 0; z < gridSize - 1; z++)
+		TerrainChunk &chunk =
+			chunks->chunks[window == 1 ? chunks->visible[k] : k];
+
+		// Iterate over all points of chunk
+		for (int x = chunk.minX; x <= chunk.maxX; x++)
 		{
-			// Draw solid shapes if applicable
-			if (wireframeMode != WIREFRAME)
+			for (int z = chunk.minZ; z <= chunk.maxZ; z++)
 			{
 				if (stripsMode == TRIANGLES)
-					drawTriangleCell(x, z, 0, window);
+					drawTriangleCell(x, z, wireframe, window);
 				else
-					drawSquareCell(x, z, 0, window);
+					drawSquareCell(x, z, wireframe, window);
 			}
 		}
 	}
+}
 
-	// Iterate over all points second time
-	for (int x = 0; x < gridSize - 1; x++)
+// Allocate terrain chunks and their mesh for current grid size
+void initMesh()
+{
+	// Split cells into chunks, boxes include wireframe drawn above terrain,
+	// and positions match vertices drawn in first window
+	chunks = new TerrainChunks(gridSize, chunkSize,
+		0 - (gridSize - 1) / 2, 0.1);
+	terrainMesh = new TerrainMesh(chunks, 0 - (gridSize - 1) / 2,
+		meshBudget);
+
+	// Picking bounds are built from heights on first pick
+	picker = new TerrainPicker(gridSize);
+}
+
+// Recompute colors of points whose heights changed, or of every point if
+// greatest height changed, before mesh or overview copy them
+void updateColors()
+{
+	if (colorGreatestHeight != terrain->greatestHeight)
 	{
-		for (int z = 0; z < gridSize - 1; z++)
+		GridRegion all = { 0, 0, gridSize - 1, gridSize - 1 };
+		addStaleRegion(colorDirty, all);
+		colorGreatestHeight = terrain->greatestHeight;
+	}
+	for (size_t i = 0; i < colorDirty.size(); i++)
+		terrain->computeColors(colorDirty[i], lowColor, highColor, 1);
+	colorDirty.clear();
+}
+
+// Camera position in object space, which is the modelview translation
+// rotated back, and pixels per unit of size at unit distance
+void viewPosition(float *camera, float &pixelScale)
+{
+	float projection[16], modelview[16];
+	GLint viewport[4];
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	camera[0] = camera[1] = camera[2] = 0;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			camera[i] -= modelview[i * 4 + j] * modelview[12 + j];
+	pixelScale = viewport[3] / 2.0 * projection[5];
+}
+
+// Cull chunks against current view and choose their levels of detail
+void cullChunks()
+{
+	// Frustum from matrices set up by reshape and display functions
+	if (cullingMode == CULL)
+	{
+		float projection[16], modelview[16];
+		glGetFloatv(GL_PROJECTION_MATRIX, projection);
+		glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+		Frustum frustum;
+		frustum.extract(projection, modelview);
+		chunks->cull(frustum);
+	}
+	else
+		chunks->showAll();
+
+	// Choose chunk levels from error projected at camera position
+	float threshold = 0;
+	float camera[3] = { 0, 0, 0 }, pixelScale = 0;
+	if (detailMode == LEVEL_OF_DETAIL && renderMode == MESH)
+	{
+		viewPosition(camera, pixelScale);
+		threshold = pixelError;
+	}
+	chunks->selectLevels(camera, pixelScale, threshold);
+
+	// Full detail chunks draw two triangles per cell, coarser chunks are
+	// counted as they are drawn
+	long fullCells = 0;
+	for (int k = 0; k < chunks->visibleCount; k++)
+	{
+		TerrainChunk &chunk = chunks->chunks[chunks->visible[k]];
+		if (chunk.level == 0)
+			fullCells += (long)(chunk.maxX - chunk.minX + 1)
+				* (chunk.maxZ - chunk.minZ + 1);
+	}
+
+	// Add to statistics
+	visibleChunkTotal += chunks->visibleCount;
+	visibleTriangleTotal += fullCells * 2;
+}
+
+// Draw mesh of chunk using current array pointers, full detail chunks as
+// one strip per row of cells and coarser chunks as triangles
+void drawChunkMesh(ChunkMesh &mesh, int rows)
+{
+	if (mesh.level != 0)
+	{
+		glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT,
+			mesh.indices.data());
+		return;
+	}
+	GLenum mode = stripsMode == TRIANGLES ? GL_TRIANGLE_STRIP : GL_QUAD_STRIP;
+	for (int x = 0; x < rows; x++)
+	{
+		stripCounts[x] = mesh.vertices.size() / rows;
+		stripFirsts[x] = x * stripCounts[x];
+	}
+	glMultiDrawArrays(mode, stripFirsts, stripCounts, rows);
+}
+
+// Draw terrain mesh of visible chunks on first window using vertex arrays
+void drawMesh(int window)
+{
+	if (window != 1)
+		return;
+
+	// Build meshes of visible chunks with current normals before drawing
+	terrainMesh->smooth = shadingMode == GOURAUD;
+	terrainMesh->triangles = stripsMode == TRIANGLES;
+	terrainMesh->update(*terrain);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	long levelTriangles = 0;
+	for (int k = 0; k < chunks->visibleCount; k++)
+	{
+		// Point vertex arrays at interleaved mesh of chunk
+		TerrainChunk &chunk = chunks->chunks[chunks->visible[k]];
+		ChunkMesh &mesh = terrainMesh->chunkMesh(*terrain,
+			chunks->visible[k]);
+		int rows = chunk.maxX - chunk.minX + 1;
+		glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex),
+			mesh.vertices[0].position);
+		glNormalPointer(GL_FLOAT, sizeof(MeshVertex),
+			mesh.vertices[0].normal);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(MeshVertex),
+			mesh.vertices[0].color);
+		levelTriangles += mesh.indices.size() / 3;
+
+		// Draw solid shapes if applicable
+		if (wireframeMode != WIREFRAME)
+		{
+			glEnableClientState(GL_COLOR_ARRAY);
+			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			drawChunkMesh(mesh, rows);
+			glDisableClientState(GL_COLOR_ARRAY);
+		}
+
+		// Draw wireframes slightly higher in single color if applicable
+		if (wireframeMode != SOLID)
 		{
-			// Draw wireframes if applicable
-			if (wireframeMode != SOLID)
+			glColor3fv(wireColor);
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			glPushMatrix();
+			glTranslatef(0, 0.1, 0);
+			drawChunkMesh(mesh, rows);
+			glPopMatrix();
+		}
+	}
+	visibleTriangleTotal += levelTriangles;
+
+	// Restore client state
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+}
+
+// Box of tile at level and position, heights between lowest and greatest
+// possible, returns whether it is in view
+int tileBox(int level, int x, int z, Frustum &frustum, float *min,
+	float *max)
+{
+	float span = (float)tileCache->header.tileSize * (1 << level);
+	float origin = 0 - (gridSize - 1) / 2, last = gridSize - 1;
+	min[0] = origin + fmin(x * span, last);
+	min[1] = 0 - tileCache->header.greatestHeight;
+	min[2] = origin + fmin(z * span, last);
+	max[0] = origin + fmin((x + 1) * span, last);
+	max[1] = tileCache->header.greatestHeight;
+	max[2] = origin + fmin((z + 1) * span, last);
+	return cullingMode == NO_CULL || frustum.intersects(min, max);
+}
+
+// Choose tiles of quadtree node, splitting it while its sample spacing
+// projects to more than error threshold and its children in view are
+// resident
+void selectTiles(const Tile *tile, Frustum &frustum, const float *camera,
+	float pixelScale)
+{
+	float min[3], max[3];
+	if (!tileBox(tile->level, tile->x, tile->z, frustum, min, max))
+		return;
+
+	// Distance from camera to nearest point of box
+	float distance = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		float outside = fmax(min[i] - camera[i], camera[i] - max[i]);
+		distance += outside > 0 ? outside * outside : 0;
+	}
+	distance = fmax(sqrt(distance), 1);
+
+	// Children are requested nearest first, node stands in for them until
+	// all are loaded
+	if (tile->level > 0
+		&& (1 << tile->level) * pixelScale / distance > pixelError)
+	{
+		const Tile *children[4];
+		int count = 0, missing = 0;
+		int tiles = tileCache->tilesPerSide(tile->level - 1);
+		for (int x = tile->x * 2; x <= tile->x * 2 + 1 && x < tiles; x++)
+		{
+			for (int z = tile->z * 2; z <= tile->z * 2 + 1 && z < tiles; z++)
 			{
-				if (stripsMode == TRIANGLES)
-					drawTriangleCell(x, z, 1, window);
-				else
-					drawSquareCell(x, z, 1, window);
+				if (!tileBox(tile->level - 1, x, z, frustum, min, max))
+					continue;
+				children[count] = tileCache->find(tile->level - 1, x, z,
+					distance);
+				missing += children[count++] == NULL;
 			}
 		}
+		if (missing == 0)
+		{
+			for (int i = 0; i < count; i++)
+				selectTiles(children[i], frustum, camera, pixelScale);
+			return;
+		}
 	}
+	drawnTiles.push_back(tile);
+}
 
-	// Flushes buffered commands to display
-	glFlush();
+// Draw chosen tiles using current array state
+void drawTileList()
+{
+	for (size_t i = 0; i < drawnTiles.size(); i++)
+	{
+		const float *vertices = drawnTiles[i]->vertices;
+		glVertexPointer(3, GL_FLOAT, 9 * sizeof(float), vertices);
+		glNormalPointer(GL_FLOAT, 9 * sizeof(float), vertices + 3);
+		glColorPointer(3, GL_FLOAT, 9 * sizeof(float), vertices + 6);
+		glDrawElements(GL_TRIANGLES, tileCache->indices.size(),
+			GL_UNSIGNED_INT, tileCache->indices.data());
+	}
+}
 
-	// Redraw terrain continuously
-	glutPostRedisplay();
+// Draw streamed terrain on first window from resident tiles, requesting
+// finer tiles where view needs them
+void drawTiles()
+{
+	// Top tile covers whole terrain and is always drawn, so wait for it
+	tileCache->beginFrame();
+	long missesBefore = tileCache->statistics().misses;
+	float projection[16], modelview[16], camera[3], pixelScale;
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	Frustum frustum;
+	frustum.extract(projection, modelview);
+	viewPosition(camera, pixelScale);
+	drawnTiles.clear();
+	selectTiles(tileCache->wait(tileCache->header.levels - 1, 0, 0),
+		frustum, camera, pixelScale);
+
+	// Draw solid shapes, then wireframes slightly higher in single color
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	if (wireframeMode != WIREFRAME)
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		drawTileList();
+	}
+	if (wireframeMode != SOLID)
+	{
+		glDisableClientState(GL_COLOR_ARRAY);
+		glColor3fv(wireColor);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		glPushMatrix();
+		glTranslatef(0, 0.1, 0);
+		drawTileList();
+		glPopMatrix();
+	}
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+
+	// Keep redrawing while missing tiles are loading
+	unsigned long completed = tileCache->completed();
+	if (tileCache->statistics().misses != missesBefore
+		|| completed != tilesCompleted)
+		requestRedraw(1);
+	tilesCompleted = completed;
+
+	// Add to statistics
+	visibleChunkTotal += drawnTiles.size();
+	visibleTriangleTotal += (long)drawnTiles.size()
+		* tileCache->header.tileSize * tileCache->header.tileSize * 2;
 }
 
-// Add circle function: add circle in circles algorithm
-void addCircle(float circleX, float circleZ,
-	float circleSize, float circleDisplacement)
+// Draw terrain grid on first and second window, updating normals and
+// mesh where it changed
+void drawGrid(int window)
 {
-	// Reset stored value for greatest height
-	greatestHeight = 0;
+	// Colors depend on greatest height, so refresh colors of every chunk
+	// mesh if it changed (point colors follow in updateColors), normals
+	// and chunk bounds stay valid
+	if (meshGreatestHeight != terrain->greatestHeight)
+	{
+		GridRegion all = { 0, 0, gridSize - 1, gridSize - 1 };
+		terrainMesh->invalidate(all);
+		meshGreatestHeight = terrain->greatestHeight;
+	}
 
-	// Adjust height for every point in grid
-	for (int x = 0; x < gridSize; x++)
+	// Recompute normals and mesh only where terrain changed since last draw
+	updateColors();
+	// Mesh vertices next to a region use normals of neighboring regions,
+	// so every normal is updated before the mesh
+	if (!dirtyRegions.empty())
 	{
-		for (int z = 0; z < gridSize; z++)
+		for (size_t i = 0; i < dirtyRegions.size(); i++)
+		{
+			GridRegion &region = dirtyRegions[i];
+			terrain->computeNormals(region,
+				stripsMode == TRIANGLES, shadingMode == GOURAUD);
+			normalCellsUpdated += (long)(region.maxX - region.minX + 1)
+				* (region.maxZ - region.minZ + 1);
+		}
+		for (size_t i = 0; i < dirtyRegions.size(); i++)
 		{
-			// Compute normalized distance from circle center
-			float distance = sqrt(pow(circleX - x, 2)
-				+ pow(circleZ - z, 2));
-			distance = distance * 2 / circleSize;
-
-			// Adjust height using cosine function
-			if (fabs(distance) <= 1)
-				heightMap[x][z] += circleDisplacement/2
-					* (cos(distance * M_PI) + 1);
-
-			// Keep record of greatest height
-			if (heightMap[x][z] > greatestHeight)
-				greatestHeight = heightMap[x][z];
+			terrainMesh->invalidate(dirtyRegions[i]);
+			chunks->updateBounds(*terrain, dirtyRegions[i]);
 		}
+		normalRecomputes++;
+		dirtyRegions.clear();
+	}
+
+	// Skip chunks outside view of first window before drawing anything
+	if (window == 1)
+		cullChunks();
+
+	// Draw retained mesh unless comparing against immediate mode
+	if (renderMode == MESH)
+		drawMesh(window);
+
+	// Draw solid shapes if applicable
+	if (renderMode == IMMEDIATE && wireframeMode != WIREFRAME)
+		drawCells(0, window);
+
+	// Draw wireframes if applicable
+	if (renderMode == IMMEDIATE && wireframeMode != SOLID)
+		drawCells(1, window);
+}
+
+// Draw terrain on first and second window
+void drawTerrain(int window)
+{
+	// Start timing frame
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	// Streamed terrain is drawn from tile cache instead of grid
+	if (tileCache != NULL)
+		drawTiles();
+	else
+		drawGrid(window);
+
+	// Wait for buffered commands to reach display, so render time of first
+	// window includes drawing
+	glFinish();
+	if (window == 1)
+	{
+		frameTimeTotal += std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+		frameCount++;
+	}
+
+	// Report statistics periodically
+	reportStats();
+}
+
+// Queue brush stamp for next frame into cluster of stamps it overlaps
+// (circles are added, so grouping them does not change the result)
+void queueStamp(float circleX, float circleZ,
+	float circleSize, float circleDisplacement)
+{
+	Circle stamp = { circleX, circleZ, circleSize, circleDisplacement };
+	terrain->clusterCircle(brushStamps, stamp);
+
+	// Both windows show new heights once batch is applied
+	requestRedraw(1);
+	requestRedraw(2);
+}
+
+// Apply queued brush stamps once per frame, each cluster over its own
+// region, so normals, mesh and overview are refreshed only where stamps
+// landed instead of over a box around the whole stroke
+void applyStamps()
+{
+	if (brushStamps.empty())
+		return;
+	for (size_t i = 0; i < brushStamps.size(); i++)
+	{
+		invalidateHeights(terrain->addCircles(brushStamps[i].circles));
+		stampsApplied += brushStamps[i].circles.size();
 	}
+	stampBatches++;
+	stampClusters += brushStamps.size();
+	brushStamps.clear();
 }
 
 // Generate new terrain using circles algorithm
 void newTerrain()
 {
-	// Variable declarations for circle dimensions/placement
-	float circleX, circleZ, circleSize, circleDisplacement;
+	generator->generate(*terrain, terrainSeed);
+	printf("Terrain seed: %llu (%s)\n", (unsigned long long)terrainSeed,
+		generator->name());
+
+	// Filters run after generation, each timed on its own with scratch
+	// memory it needed beyond grid
+	for (size_t i = 0; i < filters.size(); i++)
+	{
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		filters[i]->apply(*terrain);
+		printf("Filter %s: %.1f ms (scratch %.1f MB)\n", filters[i]->name(),
+			std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count(),
+			filters[i]->scratchBytes(gridSize) / 1048576.0);
+	}
+	GridRegion all = { 0, 0, gridSize - 1, gridSize - 1 };
+	invalidateHeights(all);
+}
 
-	// Initialize all height values to 0
-	for (int x = 0; x < gridSize; x++)
-		for (int z = 0; z < gridSize; z++)
-			heightMap[x][z] = 0;
+// Load terrain from binary height map or 16-bit PGM image, sets grid size
+// and seed, returns 0 on failure
+int loadTerrain(const char *path)
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
 
-	// Iterate number of times given by grid size
-	for (int i = 0; i < gridSize; i++)
+	// Images are converted, binary maps are used from mapped file
+	if (HeightMap::isPGM(path))
+		terrain = HeightMap::importPGM(path, 0.05);
+	else
 	{
-		// Randomize circle dimensions/placement
-		circleX = rand() % gridSize;
-		circleZ = rand() % gridSize;
-		circleSize = rand() % gridSize / 2 + 5;
-		circleDisplacement = circleSize / gridSize * 5;
+		heightMap = new HeightMap();
+		if (heightMap->open(path))
+			terrain = heightMap->createGrid();
+	}
+	if (terrain == NULL)
+		return 0;
+
+	gridSize = terrain->size;
+	terrainSeed = terrain->seed;
+	printf("Loaded %d x %d terrain from %s in %.1f ms\n", gridSize, gridSize,
+		path, std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count());
+	return 1;
+}
+
+// Save current terrain to export file
+void exportTerrain()
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	if (HeightMap::save(exportPath, *terrain, exportFormat))
+		printf("Saved %d x %d terrain to %s in %.1f ms\n", gridSize,
+			gridSize, exportPath, std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count());
+}
+
+// Create overview texture in current context and fill it completely
+void initOverview()
+{
+	// Sample every step points so texture stays within size limit
+	overviewStep = 1;
+	while ((gridSize - 1) / overviewStep + 1 > maxOverviewSize)
+		overviewStep++;
+	overviewSize = (gridSize - 1) / overviewStep + 1;
+
+	// Linear filtering blends colors between points like smooth shading
+	glGenTextures(1, &overviewTexture);
+	glBindTexture(GL_TEXTURE_2D, overviewTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, overviewSize, overviewSize, 0,
+		GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	overviewGreatestHeight = -1;
+}
 
-		// Add circle pushing up using common logic
-		addCircle(circleX, circleZ, circleSize, circleDisplacement);
+// Upload colors of sampled points within region of overview
+void uploadOverview(GridRegion region)
+{
+	// Texels of sampled points inside region (rows t along x, columns s
+	// along z)
+	int minT = (region.minX + overviewStep - 1) / overviewStep;
+	int minS = (region.minZ + overviewStep - 1) / overviewStep;
+	int maxT = fmin(region.maxX / overviewStep, overviewSize - 1);
+	int maxS = fmin(region.maxZ / overviewStep, overviewSize - 1);
+	if (minT > maxT || minS > maxS)
+		return;
+
+	// Replace only that part of texture, rows of color map are uploaded
+	// in place unless sampled
+	int width = maxS - minS + 1, height = maxT - minT + 1;
+	glBindTexture(GL_TEXTURE_2D, overviewTexture);
+	if (overviewStep == 1)
+	{
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, gridSize);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, minS, minT, width, height,
+			GL_RGBA, GL_UNSIGNED_BYTE, terrain->color(minT, minS));
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		return;
+	}
+	std::vector<uint32_t> colors((size_t)width * height);
+	for (int t = minT; t <= maxT; t++)
+		for (int s = minS; s <= maxS; s++)
+			colors[(size_t)(t - minT) * width + s - minS] =
+				terrain->colors[terrain->index(t * overviewStep,
+					s * overviewStep)];
+	glTexSubImage2D(GL_TEXTURE_2D, 0, minS, minT, width, height,
+		GL_RGBA, GL_UNSIGNED_BYTE, colors.data());
+}
+
+// Upload colors of sampled points within changed regions of overview
+void updateOverview()
+{
+	updateColors();
+
+	// Colors depend on greatest height, so refill whole texture if it changed
+	if (overviewGreatestHeight != terrain->greatestHeight)
+	{
+		GridRegion all = { 0, 0, gridSize - 1, gridSize - 1 };
+		addStaleRegion(overviewDirty, all);
+		overviewGreatestHeight = terrain->greatestHeight;
 	}
+	for (size_t i = 0; i < overviewDirty.size(); i++)
+		uploadOverview(overviewDirty[i]);
+	overviewDirty.clear();
+}
+
+// Draw overview texture as one quad on second window, texel centers of
+// sampled points land where mesh vertices used to be drawn
+void drawOverview()
+{
+	if (overviewTexture == 0)
+		initOverview();
+	updateOverview();
+
+	// Corners of sampled area in window and in texture
+	float size = (float)(overviewSize - 1) * overviewStep
+		* secondDisplayWidth / (gridSize - 1);
+	float low = 0.5 / overviewSize, high = 1 - low;
+	glEnable(GL_TEXTURE_2D);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glBindTexture(GL_TEXTURE_2D, overviewTexture);
+	glBegin(GL_QUADS);
+		glTexCoord2f(high, low);
+		glVertex2f(0, secondDisplayWidth - size);
+		glTexCoord2f(high, high);
+		glVertex2f(size, secondDisplayWidth - size);
+		glTexCoord2f(low, high);
+		glVertex2f(size, secondDisplayWidth);
+		glTexCoord2f(low, low);
+		glVertex2f(0, secondDisplayWidth);
+	glEnd();
+	glDisable(GL_TEXTURE_2D);
+	glFlush();
 }
 
 // Display function: renders terrain on first window
 void display()
 {
+	// Brush strokes since last frame change terrain before drawing
+	applyStamps();
+
+	// Window is up to date once drawn
+	windowDirty[0] = 0;
+	framesRendered++;
+
 	// Reset display before rendering terrain
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glLoadIdentity();
 
 	// Position camera in front of terrain
 	gluLookAt(
-		0, 0, gridSize,
+		0, 0, cameraDistance,
 		0, 0, 0,
 		0, 1, 0
 	);
@@ -473,11 +1147,18 @@ void display()
 // Display 2 function: renders terrain overview on second window
 void display2()
 {
+	// Brush strokes since last frame change terrain before drawing
+	applyStamps();
+
+	// Window is up to date once drawn
+	windowDirty[1] = 0;
+	framesRendered++;
+
 	// Clear OpenGL color buffer
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	// Draw terrain using common logic
-	drawTerrain(2);
+	// Draw cached color map instead of terrain
+	drawOverview();
 }
 
 // Keyboard function: handles standard keyboard controls
@@ -486,10 +1167,36 @@ void keyboard(unsigned char key, int x, int y)
 	// Perform action depending on character received
 	switch (key)
 	{
+		// Toggle level of detail for distant chunks
+		case 'd':
+		case 'D':
+			detailMode = (DetailMode)(!detailMode);
+			break;
+
+		// Save terrain to height map file
+		case 'e':
+		case 'E':
+			if (terrain != NULL)
+				exportTerrain();
+			break;
+
 		// Toggle shading
 		case 'g':
 		case 'G':
 			shadingMode = (ShadingMode)(!shadingMode);
+			invalidateNormals();
+			break;
+
+		// Toggle view-frustum culling of chunks
+		case 'c':
+		case 'C':
+			cullingMode = (CullingMode)(!cullingMode);
+			break;
+
+		// Toggle render path (retained mesh or immediate mode)
+		case 'i':
+		case 'I':
+			renderMode = (RenderMode)(!renderMode);
 			break;
 
 		// Toggle lighting
@@ -498,6 +1205,20 @@ void keyboard(unsigned char key, int x, int y)
 			lightingMode = (LightingMode)((lightingMode + 1) % 3);
 			break;
 
+		// Allow more or less screen-space error in level of detail
+		case '+':
+		case '=':
+			if (pixelError < maxPixelError)
+				pixelError *= 2;
+			printf("Level of detail error threshold: %g pixels\n", pixelError);
+			break;
+		case '-':
+		case '_':
+			if (pixelError > minPixelError)
+				pixelError /= 2;
+			printf("Level of detail error threshold: %g pixels\n", pixelError);
+			break;
+
 		// Quit program
 		case 'q':
 		case 'Q':
@@ -505,9 +1226,12 @@ void keyboard(unsigned char key, int x, int y)
 			exit(0);
 			break;
 
-		// Reset terrain
+		// Reset terrain with next seed
 		case 'r':
 		case 'R':
+			if (terrain == NULL)
+				break;
+			terrainSeed++;
 			newTerrain();
 			break;
 
@@ -515,6 +1239,7 @@ void keyboard(unsigned char key, int x, int y)
 		case 's':
 		case 'S':
 			stripsMode = (StripsMode)(!stripsMode);
+			invalidateNormals();
 			break;
 
 		// Toggle wireframe mode
@@ -524,29 +1249,146 @@ void keyboard(unsigned char key, int x, int y)
 				(WireframeMode)((wireframeMode + 1) % 3);
 			break;
 	}
+
+	// Keys change how camera window is drawn
+	requestRedraw(1);
 }
 
-// Mouse function: terrain adjustment using mouse click on second window
-void mouse(int button, int state, int x, int y)
+// Queue brush stamp at grid point for held mouse button, raising terrain
+// within limit for left button and lowering it for right button, with
+// displacement scaled by given strength
+void stampBrush(float x, float z, float strength)
+{
+	// Heights are checked with stamps still queued added, so fast strokes
+	// stay within the same limits as single clicks
+	float height = terrain->height(x, z);
+	for (size_t i = 0; i < brushStamps.size(); i++)
+		for (size_t j = 0; j < brushStamps[i].circles.size(); j++)
+			height += terrain->circleHeight(brushStamps[i].circles[j],
+				(int)x, (int)z);
+	if (brushButton == GLUT_LEFT_BUTTON && height <= gridSize / 3)
+		queueStamp(x, z, gridSize / 5, gridSize / 50 * strength);
+	if (brushButton == GLUT_RIGHT_BUTTON && height >= 1)
+		queueStamp(x, z, gridSize / 5, -1 * gridSize / 50 * strength);
+}
+
+// Grid point under cursor in first window, found by casting ray from
+// camera through cursor into terrain; returns 0 if ray misses terrain
+int pickTerrain(int x, int y, float &gridX, float &gridZ)
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	// Camera as set up by reshape and display functions
+	double modelview[16], projection[16];
+	GLint viewport[4];
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	gluLookAt(0, 0, cameraDistance, 0, 0, 0, 0, 1, 0);
+	glRotatef(cameraRotationX, 1, 0, 0);
+	glRotatef(cameraRotationY, 0, 1, 0);
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+	glPopMatrix();
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// Points under center of cursor pixel on near and far planes, moved
+	// from terrain space (centered on grid) into grid space
+	double nearPoint[3], farPoint[3];
+	double windowX = x + 0.5, windowY = viewport[3] - y - 0.5;
+	gluUnProject(windowX, windowY, 0, modelview, projection, viewport,
+		&nearPoint[0], &nearPoint[1], &nearPoint[2]);
+	gluUnProject(windowX, windowY, 1, modelview, projection, viewport,
+		&farPoint[0], &farPoint[1], &farPoint[2]);
+	float origin = 0 - (gridSize - 1) / 2;
+	float rayStart[3] = { (float)(nearPoint[0] - origin),
+		(float)nearPoint[1], (float)(nearPoint[2] - origin) };
+	float rayDirection[3];
+	for (int k = 0; k < 3; k++)
+		rayDirection[k] = farPoint[k] - nearPoint[k];
+
+	// Bounds only refreshed where heights changed since last pick
+	for (size_t i = 0; i < pickDirty.size(); i++)
+		picker->update(*terrain, pickDirty[i]);
+	pickDirty.clear();
+	float hit[3];
+	int found = picker->cast(*terrain, rayStart, rayDirection, hit);
+	picksCast++;
+	pickTimeTotal += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+	if (!found)
+		return 0;
+
+	// Nearest grid point to hit
+	gridX = fmin(fmax(floor(hit[0] + 0.5), 0), gridSize - 1);
+	gridZ = fmin(fmax(floor(hit[2] + 0.5), 0), gridSize - 1);
+	return 1;
+}
+
+// Grid point under window position, clamped to grid in second window and
+// picked from terrain in first window; returns 0 if cursor is not over
+// terrain
+int windowToGrid(int x, int y, float &gridX, float &gridZ)
 {
+	if (glutGetWindow() == windowIds[0])
+		return pickTerrain(x, y, gridX, gridZ);
+
 	// Scale and round coordinates based on grid size
-	x = floor(x * gridSize / secondDisplayWidth);
-	y = floor(y * gridSize / secondDisplayHeight);
+	gridX = floor((float)x * gridSize / secondDisplayWidth);
+	gridZ = floor((float)y * gridSize / secondDisplayHeight);
+	gridX = fmin(fmax(gridX, 0), gridSize - 1);
+	gridZ = fmin(fmax(gridZ, 0), gridSize - 1);
+	return 1;
+}
 
-	// Increase height within limit on left mouse click
-	if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)
+// Mouse function: start or end brush stroke on either window, a click
+// stamps once at full strength
+void mouse(int button, int state, int x, int y)
+{
+	// Stroke ends when its button is released
+	if (state == GLUT_UP)
 	{
-		// Add circle pushing upward using common logic
-		if (heightMap[x][y] <= gridSize / 3)
-			addCircle(x, y, gridSize / 5, gridSize / 50);
+		if (button == brushButton)
+			brushButton = -1;
+		return;
 	}
+	if (button != GLUT_LEFT_BUTTON && button != GLUT_RIGHT_BUTTON)
+		return;
 
-	// Decrease height within limit on right mouse click
-	if (button == GLUT_RIGHT_BUTTON && state == GLUT_DOWN)
+	// Streamed terrain has no grid to edit
+	if (terrain == NULL)
+		return;
+
+	// Increase height on left click, decrease it on right click, nothing
+	// happens when clicking past terrain in first window
+	if (!windowToGrid(x, y, brushX, brushZ))
+		return;
+	brushButton = button;
+	stampBrush(brushX, brushZ, 1);
+}
+
+// Motion function: continue brush stroke while dragging, stamps spaced
+// evenly along path at fraction of full strength so a stroke rises about
+// as high as a click
+void motion(int x, int y)
+{
+	// Stroke pauses while cursor is past terrain in first window
+	float gridX, gridZ;
+	if (brushButton < 0 || !windowToGrid(x, y, gridX, gridZ))
+		return;
+
+	// Stamps every eighth of brush size from last stamp towards cursor
+	float spacing = fmax(gridSize / 5 / 8, 1);
+	float dx = gridX - brushX, dz = gridZ - brushZ;
+	int stamps = sqrt(dx * dx + dz * dz) / spacing;
+	for (int i = 1; i <= stamps; i++)
+		stampBrush(floor(brushX + dx * i / stamps + 0.5),
+			floor(brushZ + dz * i / stamps + 0.5), 0.25);
+	if (stamps > 0)
 	{
-		// Add circle pushing downward using common logic
-		if (heightMap[x][y] >= 1)
-			addCircle(x, y, gridSize / 5, -1 * gridSize / 50);
+		brushX = gridX;
+		brushZ = gridZ;
 	}
 }
 
@@ -577,7 +1419,19 @@ void special(int key, int x, int y)
 		case GLUT_KEY_RIGHT:
 			cameraRotationY--;
 			break;
+
+		// Zoom camera in towards center of terrain or back out
+		case GLUT_KEY_PAGE_UP:
+			if (cameraDistance > gridSize / maxZoom)
+				cameraDistance /= 1.25;
+			break;
+		case GLUT_KEY_PAGE_DOWN:
+			cameraDistance = fmin(cameraDistance * 1.25, gridSize);
+			break;
 	}
+
+	// Camera moved, so redraw camera window
+	requestRedraw(1);
 }
 
 // Reshape function: adjusts terrain view upon resize of first window
@@ -586,7 +1440,7 @@ void reshape(int w, int h)
 	glViewport(0, 0, w, h);
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	gluPerspective(45, 1, 1, maxGridSize * 2);
+	gluPerspective(45, 1, 1, gridSize * 2);
 	glMatrixMode(GL_MODELVIEW);
 }
 
@@ -607,32 +1461,342 @@ void reshape2(int w, int h)
 	glViewport(0, 0, secondDisplayWidth, secondDisplayHeight);
 }
 
+// Enable depth test, backface culling and lighting in current context
+// for 3D camera view
+void initCameraView()
+{
+	// Enable backface culling
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+
+	// Enable lighting with color
+	glEnable(GL_LIGHTING);
+	glEnable(GL_COLOR_MATERIAL);
+	glEnable(GL_NORMALIZE);
+}
+
+// Index of value in NULL-terminated list of names, -1 if not found
+int findName(const char *value, const char **names)
+{
+	for (int i = 0; names[i] != NULL; i++)
+		if (strcmp(value, names[i]) == 0)
+			return i;
+	return -1;
+}
+
+// Render frames of both windows offscreen, optionally saving each frame
+// as PPM files starting with dump prefix, and report frame times
+int runHeadless(int frames, const char *dumpPrefix)
+{
+	// One context per window, like the two GLUT windows
+	HeadlessContext camera(windowSize, windowSize);
+	HeadlessContext overview(windowSize, windowSize);
+	if (!camera.valid() || (tileCache == NULL && !overview.valid()))
+	{
+		printf("Headless rendering needs EGL with the surfaceless"
+			" platform (e.g. Mesa llvmpipe).\n");
+		return EXIT_FAILURE;
+	}
+	camera.makeCurrent();
+	initCameraView();
+	reshape(windowSize, windowSize);
+	if (tileCache == NULL)
+	{
+		overview.makeCurrent();
+		reshape2(windowSize, windowSize);
+	}
+
+	// Time each frame of both windows until rendering has finished
+	std::vector<double> times;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		camera.makeCurrent();
+		display();
+		glFinish();
+		if (tileCache == NULL)
+		{
+			overview.makeCurrent();
+			display2();
+			glFinish();
+		}
+		times.push_back(std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count());
+
+		// Save both windows of frame if requested
+		if (dumpPrefix != NULL)
+		{
+			char path[1024];
+			snprintf(path, sizeof(path), "%s%04d-camera.ppm",
+				dumpPrefix, frame);
+			if (!camera.savePPM(path))
+				printf("Could not write %s.\n", path);
+			if (tileCache != NULL)
+				continue;
+			snprintf(path, sizeof(path), "%s%04d-overview.ppm",
+				dumpPrefix, frame);
+			if (!overview.savePPM(path))
+				printf("Could not write %s.\n", path);
+		}
+	}
+
+	// Report minimum, average and 99th percentile frame times
+	if (frames > 0)
+	{
+		std::sort(times.begin(), times.end());
+		double total = 0;
+		for (int i = 0; i < frames; i++)
+			total += times[i];
+		printf("Frame times over %d frames: min %.2f ms, avg %.2f ms,"
+			" p99 %.2f ms\n", frames, times[0], total / frames,
+			times[(frames * 99 + 99) / 100 - 1]);
+	}
+	return EXIT_SUCCESS;
+}
+
 // Main function: entry point and initialization
 int main(int argc, char ** argv)
 {
+	// Seed from command line (--seed N) or current time, and generator
+	// from command line (--generator name) or circles algorithm
+	terrainSeed = time(NULL);
+	generator = TerrainGenerator::create(TerrainGenerator::names[0]);
+
+	// Headless mode options: grid size, display modes, number of frames
+	// and optional prefix of PPM files to dump frames to
+	static const char *shadingNames[] = { "flat", "gouraud", NULL };
+	static const char *stripsNames[] = { "squares", "triangles", NULL };
+	static const char *wireframeNames[] = { "solid", "wireframe", "both",
+		NULL };
+	int frames = 100;
+	const char *dumpPrefix = NULL;
+
+	// Height map to load instead of generating terrain, and whether to
+	// save terrain once ready (--save path, --save-format name)
+	static const char *formatNames[] = { "float32", "uint16", NULL };
+	const char *loadPath = NULL;
+	int saveAtStart = 0;
+
+	// Tiled terrain to stream (--stream path, --cache-mb budget), or
+	// height map to convert into one (--make-tiles source destination,
+	// --tile-size cells), and zoom of camera (--zoom factor)
+	const char *streamPath = NULL;
+	const char *tilesSource = NULL, *tilesPath = NULL;
+	int tileSize = 256;
+	float zoom = 1;
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--headless") == 0)
+			headless = 1;
+
+	for (int i = 1; i < argc - 1; i++)
+	{
+		// Display mode names, -1 if unknown
+		int mode = 0;
+		if (strcmp(argv[i], "--shading") == 0
+			&& (mode = findName(argv[i + 1], shadingNames)) >= 0)
+			shadingMode = (ShadingMode)mode;
+		if (strcmp(argv[i], "--strips") == 0
+			&& (mode = findName(argv[i + 1], stripsNames)) >= 0)
+			stripsMode = (StripsMode)mode;
+		if (strcmp(argv[i], "--wireframe") == 0
+			&& (mode = findName(argv[i + 1], wireframeNames)) >= 0)
+			wireframeMode = (WireframeMode)mode;
+		if (strcmp(argv[i], "--save-format") == 0
+			&& (mode = findName(argv[i + 1], formatNames)) >= 0)
+			exportFormat = (HeightMapFormat)mode;
+		if (mode < 0)
+		{
+			printf("Unknown mode %s for %s.\n", argv[i + 1], argv[i]);
+			exit(EXIT_FAILURE);
+		}
+
+		if (strcmp(argv[i], "--size") == 0)
+			gridSize = atoi(argv[i + 1]);
+		if (strcmp(argv[i], "--load") == 0)
+			loadPath = argv[i + 1];
+		if (strcmp(argv[i], "--save") == 0)
+		{
+			exportPath = argv[i + 1];
+			saveAtStart = 1;
+		}
+		if (strcmp(argv[i], "--fps") == 0)
+			fpsCap = atoi(argv[i + 1]) > 0 ? atoi(argv[i + 1]) : 0;
+		if (strcmp(argv[i], "--frames") == 0)
+			frames = atoi(argv[i + 1]);
+		if (strcmp(argv[i], "--dump") == 0)
+			dumpPrefix = argv[i + 1];
+		if (strcmp(argv[i], "--seed") == 0)
+			terrainSeed = strtoull(argv[i + 1], NULL, 10);
+		if (strcmp(argv[i], "--filters") == 0)
+		{
+			// Comma-separated filter names
+			std::vector<char> names(argv[i + 1],
+				argv[i + 1] + strlen(argv[i + 1]) + 1);
+			for (char *name = strtok(names.data(), ","); name != NULL;
+				name = strtok(NULL, ","))
+			{
+				TerrainFilter *filter = TerrainFilter::create(name);
+				if (filter == NULL)
+				{
+					printf("Unknown filter %s (choose gaussian, thermal"
+						" or hydraulic).\n", name);
+					exit(EXIT_FAILURE);
+				}
+				filters.push_back(filter);
+			}
+		}
+		if (strcmp(argv[i], "--stream") == 0)
+			streamPath = argv[i + 1];
+		if (strcmp(argv[i], "--cache-mb") == 0)
+			cacheBudget = (size_t)atoi(argv[i + 1]) << 20;
+		if (strcmp(argv[i], "--mesh-mb") == 0)
+			meshBudget = (size_t)atoi(argv[i + 1]) << 20;
+		if (strcmp(argv[i], "--make-tiles") == 0 && i + 2 < argc)
+		{
+			tilesSource = argv[i + 1];
+			tilesPath = argv[i + 2];
+		}
+		if (strcmp(argv[i], "--tile-size") == 0)
+			tileSize = atoi(argv[i + 1]);
+		if (strcmp(argv[i], "--zoom") == 0)
+			zoom = fmin(fmax(atof(argv[i + 1]), 1), maxZoom);
+		if (strcmp(argv[i], "--generator") == 0)
+		{
+			delete generator;
+			generator = TerrainGenerator::create(argv[i + 1]);
+			if (generator == NULL)
+			{
+				printf("Unknown generator %s (choose circles, faults"
+					" or diamond).\n", argv[i + 1]);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	// Convert height map into tiled terrain without rendering
+	if (tilesSource != NULL)
+	{
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		HeightMap source;
+		if (tileSize < 16 || tileSize > 1024)
+		{
+			printf("Tile size must be between 16 and 1024.\n");
+			exit(EXIT_FAILURE);
+		}
+		if (!source.open(tilesSource)
+			|| !TileCache::write(tilesPath, source, tileSize))
+			exit(EXIT_FAILURE);
+		printf("Wrote %u x %u terrain to %s as %d x %d tiles in %.1f ms\n",
+			source.header.width, source.header.width, tilesPath, tileSize,
+			tileSize, std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count());
+		return EXIT_SUCCESS;
+	}
+
+	// Streamed terrain decides grid size, and is never held in memory as
+	// a whole, so it may exceed largest grid size
+	if (streamPath != NULL)
+	{
+		tileCache = new TileCache(streamPath, cacheBudget, lowColor,
+			highColor);
+		if (!tileCache->valid())
+			exit(EXIT_FAILURE);
+		gridSize = tileCache->header.size;
+		terrainSeed = tileCache->header.seed;
+		printf("Streaming %d x %d terrain from %s (%u levels of %u x %u"
+			" tiles, %d tiles cached in %.1f MB)\n", gridSize, gridSize,
+			streamPath, tileCache->header.levels, tileCache->header.tileSize,
+			tileCache->header.tileSize, tileCache->capacity(),
+			cacheBudget / 1048576.0);
+	}
+
+	// Loaded terrain decides grid size
+	if (loadPath != NULL && tileCache == NULL && !loadTerrain(loadPath))
+		exit(EXIT_FAILURE);
+	if (terrain != NULL && (gridSize < minGridSize || gridSize > maxGridSize))
+	{
+		printf("Loaded grid size must be between %d and %d.\n",
+			minGridSize, maxGridSize);
+		exit(EXIT_FAILURE);
+	}
+
+	// Headless mode cannot prompt, so grid size must be given
+	if (headless && tileCache == NULL
+		&& (gridSize < minGridSize || gridSize > maxGridSize))
+	{
+		printf("Headless mode needs --size between %d and %d.\n",
+			minGridSize, maxGridSize);
+		exit(EXIT_FAILURE);
+	}
+
 	// Prompt for square grid size in command line
-	while (gridSize < minGridSize || gridSize > maxGridSize)
+	while (tileCache == NULL
+		&& (gridSize < minGridSize || gridSize > maxGridSize))
 	{
 		printf("Enter a grid size for the terrain"
-			" (between 50 and 300): ");
+			" (between %d and %d): ", minGridSize, maxGridSize);
 		scanf("%d", &gridSize);
 	}
 
 	// Display keyboard controls to command line
-	printf("Keyboard controls (both windows):\n"
-		" - Arrows -> Move camera\n"
-		" - G      -> Toggle shading (flat or Gouraud)\n"
-		" - L      -> Toggle lighting (2 sources or off)\n"
-		" - Q/Esc  -> Quit program\n"
-		" - R      -> Reset terrain\n"
-		" - S      -> Toggle strips (polygon) mode\n"
-		" - W      -> Toggle wireframe mode\n"
-		"Mouse controls (second window only):\n"
-		" - Left click  -> Increase height where clicked\n"
-		" - Right click -> Decrease height where clicked\n");
-
-	// Generate new terrain
-	newTerrain();
+	if (!headless)
+		printf("Keyboard controls (both windows):\n"
+			" - Arrows -> Move camera\n"
+			" - PgUp   -> Zoom camera in\n"
+			" - PgDn   -> Zoom camera out\n"
+			" - C      -> Toggle view-frustum culling\n"
+			" - D      -> Toggle level of detail for distant terrain\n"
+			" - E      -> Save terrain to height map file\n"
+			" - +/-    -> More or less level of detail error allowed\n"
+			" - G      -> Toggle shading (flat or Gouraud)\n"
+			" - I      -> Toggle render path (mesh or immediate)\n"
+			" - L      -> Toggle lighting (2 sources or off)\n"
+			" - Q/Esc  -> Quit program\n"
+			" - R      -> Reset terrain\n"
+			" - S      -> Toggle strips (polygon) mode\n"
+			" - W      -> Toggle wireframe mode\n"
+			"Mouse controls (either window):\n"
+			" - Left click  -> Increase height where clicked\n"
+			" - Right click -> Decrease height where clicked\n"
+			" - Drag        -> Raise or lower terrain along path\n");
+
+	// Camera starts at zoom given on command line
+	cameraDistance = gridSize / zoom;
+
+	// Allocate mesh sized to grid size, and terrain grid unless loaded or
+	// streamed
+	if (tileCache == NULL)
+		initMesh();
+	if (terrain != NULL)
+	{
+		GridRegion all = { 0, 0, gridSize - 1, gridSize - 1 };
+		invalidateHeights(all);
+	}
+	else if (tileCache == NULL)
+	{
+		// Generate new terrain and report memory use and generation time
+		terrain = new TerrainGrid(gridSize);
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		newTerrain();
+		printf("Generated %d x %d terrain in %.1f ms"
+			" (grid %.1f MB, mesh up to %.1f MB)\n", gridSize, gridSize,
+			std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count(),
+			terrain->bytes() / 1048576.0,
+			fmin(terrainMesh->fullDetailBytes(), meshBudget) / 1048576.0);
+	}
+
+	// Save terrain straight away if requested
+	if (saveAtStart && terrain != NULL)
+		exportTerrain();
+
+	// Render offscreen instead of opening windows
+	if (headless)
+		return runHeadless(frames, dumpPrefix);
 
 	// GLUT initialization
 	glutInit(&argc, argv);
@@ -645,23 +1809,27 @@ int main(int argc, char ** argv)
 		(glutGet(GLUT_SCREEN_HEIGHT) - windowSize) / 2);
 
 	// Create window for displaying terrain
-	glutCreateWindow("3GC3 - Assignment 3 | 3D Camera View");
+	windowIds[0] = glutCreateWindow("3GC3 - Assignment 3 | 3D Camera View");
 
 	// I/O function bindings
 	glutDisplayFunc(display);
 	glutKeyboardFunc(keyboard);
 	glutReshapeFunc(reshape);
 	glutSpecialFunc(special);
+	glutMouseFunc(mouse);
+	glutMotionFunc(motion);
 
-	// Enable backface culling
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	// Set up OpenGL state of first window
+	initCameraView();
 
-	// Enable lighting with color
-	glEnable(GL_LIGHTING);
-	glEnable(GL_COLOR_MATERIAL);
-	glEnable(GL_NORMALIZE);
+	// Streamed terrain has no grid to draw an overview of or edit
+	if (tileCache != NULL)
+	{
+		if (fpsCap > 0)
+			glutTimerFunc(1000 / fpsCap, scheduleRedraws, 0);
+		glutMainLoop();
+		return 0;
+	}
 
 	// Set dimensions and position of second window
 	glutInitWindowSize(windowSize, windowSize);
@@ -670,15 +1838,20 @@ int main(int argc, char ** argv)
 		(glutGet(GLUT_SCREEN_HEIGHT) - windowSize) / 2);
 
 	// Create window for displaying terrain
-	glutCreateWindow("3GC3 - Assignment 3 | 2D Overview");
+	windowIds[1] = glutCreateWindow("3GC3 - Assignment 3 | 2D Overview");
 
 	// I/O function bindings
 	glutDisplayFunc(display2);
 	glutKeyboardFunc(keyboard);
 	glutMouseFunc(mouse);
+	glutMotionFunc(motion);
 	glutReshapeFunc(reshape2);
 	glutSpecialFunc(special);
 
+	// Redraw only windows marked as changed, within frame rate cap
+	if (fpsCap > 0)
+		glutTimerFunc(1000 / fpsCap, scheduleRedraws, 0);
+
 	// Main program loop
 	glutMainLoop();
 
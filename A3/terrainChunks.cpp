@@ -0,0 +1,352 @@
+// Standard C++ library imports
+#include <math.h>
+
+// Local imports
+#include "terrainChunks.h"
+#include "threadPool.h"
+
+// Extract planes from column-major OpenGL projection and modelview
+// matrices, planes are in the modelview's object space
+void Frustum::extract(const float *projection, const float *modelview)
+{
+	// Combined clip matrix = projection * modelview
+	float clip[16];
+	for (int column = 0; column < 4; column++)
+		for (int row = 0; row < 4; row++)
+		{
+			clip[column * 4 + row] = 0;
+			for (int k = 0; k < 4; k++)
+				clip[column * 4 + row] += projection[k * 4 + row]
+					* modelview[column * 4 + k];
+		}
+
+	// Each plane is the last row of clip matrix plus or minus another row
+	// (left, right, bottom, top, near, far)
+	for (int i = 0; i < 6; i++)
+	{
+		int row = i / 2;
+		float sign = i % 2 == 0 ? 1 : -1;
+		for (int j = 0; j < 4; j++)
+			planes[i][j] = clip[j * 4 + 3] + sign * clip[j * 4 + row];
+	}
+}
+
+// Check whether axis-aligned box from min to max is at least partially
+// inside (conservative, may keep boxes just outside)
+int Frustum::intersects(const float *min, const float *max) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// Corner of box furthest along plane normal
+		const float *plane = planes[i];
+		float distance = plane[3];
+		for (int j = 0; j < 3; j++)
+			distance += plane[j] * (plane[j] >= 0 ? max[j] : min[j]);
+
+		// Whole box is outside if even that corner is
+		if (distance < 0)
+			return 0;
+	}
+	return 1;
+}
+
+// Constructor: split cells of grid into chunks with flat bounding boxes
+TerrainChunks::TerrainChunks(int gridSize, int chunkSize, float origin,
+	float margin)
+{
+	this->gridSize = gridSize;
+	this->chunkSize = chunkSize;
+	this->margin = margin;
+	perSide = (gridSize - 1 + chunkSize - 1) / chunkSize;
+
+	// Levels up to one sampling every point of chunk side
+	levels = 1;
+	while (levels < maxChunkLevels && (1 << levels) <= chunkSize)
+		levels++;
+	count = perSide * perSide;
+	chunks = new TerrainChunk[count];
+	visible = new int[count];
+	visibleCount = 0;
+	visibleCells = 0;
+
+	for (int i = 0; i < perSide; i++)
+	{
+		for (int j = 0; j < perSide; j++)
+		{
+			// Last chunk on each side may be smaller
+			TerrainChunk &chunk = chunks[i * perSide + j];
+			chunk.minX = i * chunkSize;
+			chunk.minZ = j * chunkSize;
+			chunk.maxX = fmin(chunk.minX + chunkSize, gridSize - 1) - 1;
+			chunk.maxZ = fmin(chunk.minZ + chunkSize, gridSize - 1) - 1;
+
+			// Box spans points on both sides of its cells
+			chunk.boxMin[0] = origin + chunk.minX;
+			chunk.boxMin[1] = 0;
+			chunk.boxMin[2] = origin + chunk.minZ;
+			chunk.boxMax[0] = origin + chunk.maxX + 1;
+			chunk.boxMax[1] = margin;
+			chunk.boxMax[2] = origin + chunk.maxZ + 1;
+
+			// Full detail until heights are known
+			for (int level = 0; level < maxChunkLevels; level++)
+				chunk.errors[level] = 0;
+			chunk.level = 0;
+		}
+	}
+	showAll();
+}
+
+// Destructor
+TerrainChunks::~TerrainChunks()
+{
+	delete[] chunks;
+	delete[] visible;
+}
+
+// Recompute height bounds of chunks containing points in region
+void TerrainChunks::updateBounds(TerrainGrid &grid, GridRegion region)
+{
+	// Points on a chunk border belong to chunks on both sides
+	int firstRow = (fmax(region.minX, 1) - 1) / chunkSize;
+	int lastRow = fmin(region.maxX / chunkSize, perSide - 1);
+	int firstColumn = (fmax(region.minZ, 1) - 1) / chunkSize;
+	int lastColumn = fmin(region.maxZ / chunkSize, perSide - 1);
+	if (firstRow > lastRow || firstColumn > lastColumn)
+		return;
+
+	// Rows of chunks in parallel, each chunk scans all of its points
+	ThreadPool::shared().run(lastRow - firstRow + 1, [&](int task)
+	{
+		int i = firstRow + task;
+		for (int j = firstColumn; j <= lastColumn; j++)
+		{
+			TerrainChunk &chunk = chunks[i * perSide + j];
+			float low = grid.height(chunk.minX, chunk.minZ), high = low;
+			for (int x = chunk.minX; x <= chunk.maxX + 1; x++)
+			{
+				float *row = &grid.heights[grid.index(x, 0)];
+				for (int z = chunk.minZ; z <= chunk.maxZ + 1; z++)
+				{
+					low = row[z] < low ? row[z] : low;
+					high = row[z] > high ? row[z] : high;
+				}
+			}
+			chunk.boxMin[1] = low;
+			chunk.boxMax[1] = high + margin;
+
+			// Errors never shrink at coarser levels
+			for (int level = 1; level < levels; level++)
+				chunk.errors[level] = fmax(chunk.errors[level - 1],
+					levelError(grid, chunk, 1 << level));
+		}
+	});
+}
+
+// Fill visible chunk list with chunks intersecting frustum
+void TerrainChunks::cull(const Frustum &frustum)
+{
+	visibleCount = 0;
+	visibleCells = 0;
+	for (int i = 0; i < count; i++)
+	{
+		TerrainChunk &chunk = chunks[i];
+		if (!frustum.intersects(chunk.boxMin, chunk.boxMax))
+			continue;
+		visible[visibleCount++] = i;
+		visibleCells += (long)(chunk.maxX - chunk.minX + 1)
+			* (chunk.maxZ - chunk.minZ + 1);
+	}
+}
+
+// Mark every chunk as visible
+void TerrainChunks::showAll()
+{
+	visibleCount = 0;
+	visibleCells = 0;
+	for (int i = 0; i < count; i++)
+	{
+		TerrainChunk &chunk = chunks[i];
+		visible[visibleCount++] = i;
+		visibleCells += (long)(chunk.maxX - chunk.minX + 1)
+			* (chunk.maxZ - chunk.minZ + 1);
+	}
+}
+
+// Greatest height difference between grid points of chunk and triangles
+// sampling every step points
+float TerrainChunks::levelError(TerrainGrid &grid, TerrainChunk &chunk,
+	int step)
+{
+	float error = 0;
+	for (int x0 = chunk.minX; x0 <= chunk.maxX; x0 += step)
+	{
+		for (int z0 = chunk.minZ; z0 <= chunk.maxZ; z0 += step)
+		{
+			// Last cell on each side may be smaller
+			int x1 = fmin(x0 + step, chunk.maxX + 1);
+			int z1 = fmin(z0 + step, chunk.maxZ + 1);
+			float h00 = grid.height(x0, z0), h01 = grid.height(x0, z1);
+			float h10 = grid.height(x1, z0), h11 = grid.height(x1, z1);
+
+			// Interpolate within triangle on either side of diagonal
+			for (int x = x0; x <= x1; x++)
+			{
+				float u = (float)(x - x0) / (x1 - x0);
+				float *row = &grid.heights[grid.index(x, 0)];
+				for (int z = z0; z <= z1; z++)
+				{
+					float v = (float)(z - z0) / (z1 - z0);
+					float height = u >= v
+						? h00 + u * (h10 - h00) + v * (h11 - h10)
+						: h00 + v * (h01 - h00) + u * (h11 - h01);
+					float difference = fabs(row[z] - height);
+					error = difference > error ? difference : error;
+				}
+			}
+		}
+	}
+	return error;
+}
+
+// Select coarsest level of each chunk whose error, projected from nearest
+// point of box to camera position, stays within threshold
+void TerrainChunks::selectLevels(const float *camera, float pixelScale,
+	float threshold)
+{
+	for (int i = 0; i < count; i++)
+	{
+		// Distance to nearest point of box, at least 1 inside box
+		TerrainChunk &chunk = chunks[i];
+		float distance = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			float nearest = fmin(fmax(camera[j], chunk.boxMin[j]),
+				chunk.boxMax[j]);
+			distance += (nearest - camera[j]) * (nearest - camera[j]);
+		}
+		distance = fmax(sqrt(distance), 1);
+
+		// Coarsen while projected error stays within threshold
+		chunk.level = 0;
+		while (threshold > 0 && chunk.level + 1 < levels
+			&& chunk.errors[chunk.level + 1]
+			* pixelScale <= threshold * distance)
+			chunk.level++;
+	}
+}
+
+// Step of chunk (i, j), or 0 past edge of grid
+int TerrainChunks::chunkStep(int i, int j)
+{
+	if (i < 0 || j < 0 || i >= perSide || j >= perSide)
+		return 0;
+	return 1 << chunks[i * perSide + j].level;
+}
+
+// Append triangle of grid points, flipped if needed so it faces up like
+// full detail mesh, degenerate triangles are left out
+static void appendTriangle(std::vector<unsigned int> &indices,
+	int gridSize, const int *a, const int *b, const int *c)
+{
+	int facing = (b[1] - a[1]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[1] - a[1]);
+	if (facing == 0)
+		return;
+	if (facing < 0)
+	{
+		const int *swap = b;
+		b = c;
+		c = swap;
+	}
+	indices.push_back(a[0] * gridSize + a[1]);
+	indices.push_back(b[0] * gridSize + b[1]);
+	indices.push_back(c[0] * gridSize + c[1]);
+}
+
+// Append triangles of cell from (x0, z0) to (x1, z1) with sides split
+// every given number of points (lower x, upper x, lower z, upper z)
+void TerrainChunks::appendCell(std::vector<unsigned int> &indices,
+	int x0, int z0, int x1, int z1, const int *splits)
+{
+	int corner00[] = { x0, z0 }, corner01[] = { x0, z1 };
+	int corner10[] = { x1, z0 }, corner11[] = { x1, z1 };
+
+	// Unsplit cell uses same diagonal as full detail mesh
+	if (splits[0] >= z1 - z0 && splits[1] >= z1 - z0
+		&& splits[2] >= x1 - x0 && splits[3] >= x1 - x0)
+	{
+		appendTriangle(indices, gridSize, corner00, corner11, corner10);
+		appendTriangle(indices, gridSize, corner00, corner01, corner11);
+		return;
+	}
+
+	// Points around cell in order, each side from its first corner up to
+	// next corner with split points aligned to lower corner in between
+	// (lower z, upper x, upper z backwards, lower x backwards)
+	std::vector<int> loop;
+	for (int x = x0; x < x1; x += splits[2])
+		loop.insert(loop.end(), { x, z0 });
+	for (int z = z0; z < z1; z += splits[1])
+		loop.insert(loop.end(), { x1, z });
+	for (int x = x1; x > x0; x = x0 + (x - x0 - 1) / splits[3] * splits[3])
+		loop.insert(loop.end(), { x, z1 });
+	for (int z = z1; z > z0; z = z0 + (z - z0 - 1) / splits[0] * splits[0])
+		loop.insert(loop.end(), { x0, z });
+
+	// Fan from center of cell covers every split point without cracks
+	int center[] = { (x0 + x1) / 2, (z0 + z1) / 2 };
+	for (size_t k = 0; k < loop.size(); k += 2)
+	{
+		size_t next = (k + 2) % loop.size();
+		appendTriangle(indices, gridSize, center, &loop[k], &loop[next]);
+	}
+}
+
+// Steps each side of chunk is split to so it meets its neighbors
+void TerrainChunks::levelSplits(int index, int *splits)
+{
+	int i = index / perSide, j = index % perSide;
+	int step = 1 << chunks[index].level;
+	splits[0] = chunkStep(i - 1, j);
+	splits[1] = chunkStep(i + 1, j);
+	splits[2] = chunkStep(i, j - 1);
+	splits[3] = chunkStep(i, j + 1);
+	for (int side = 0; side < 4; side++)
+		if (splits[side] == 0 || splits[side] > step)
+			splits[side] = step;
+}
+
+// Append grid point indices of triangles for chunk above finest level,
+// edges next to finer chunks are split to match them
+void TerrainChunks::appendLevelTriangles(int index,
+	std::vector<unsigned int> &indices)
+{
+	TerrainChunk &chunk = chunks[index];
+	if (chunk.level == 0)
+		return;
+
+	// Chunk sides split to step of finer neighbor (lower x, upper x,
+	// lower z, upper z), own step at edge of grid
+	int step = 1 << chunk.level;
+	int neighbors[4];
+	levelSplits(index, neighbors);
+
+	for (int x0 = chunk.minX; x0 <= chunk.maxX; x0 += step)
+	{
+		for (int z0 = chunk.minZ; z0 <= chunk.maxZ; z0 += step)
+		{
+			// Last cell on each side may be smaller, only sides on chunk
+			// edge are split
+			int x1 = fmin(x0 + step, chunk.maxX + 1);
+			int z1 = fmin(z0 + step, chunk.maxZ + 1);
+			int splits[] =
+			{
+				x0 == chunk.minX ? neighbors[0] : step,
+				x1 == chunk.maxX + 1 ? neighbors[1] : step,
+				z0 == chunk.minZ ? neighbors[2] : step,
+				z1 == chunk.maxZ + 1 ? neighbors[3] : step
+			};
+			appendCell(indices, x0, z0, x1, z1, splits);
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef TERRAINCHUNKS_H
+#define TERRAINCHUNKS_H
+
+#include <vector>
+
+#include "terrainGrid.h"
+
+// Most detail levels per chunk, level L samples every 2^L points
+static const int maxChunkLevels = 8;
+
+// Six clip planes (a, b, c, d) of a view frustum, inside where
+// ax + by + cz + d >= 0
+struct Frustum
+{
+	float planes[6][4];
+
+	// Extract planes from column-major OpenGL projection and modelview
+	// matrices, planes are in the modelview's object space
+	void extract(const float *projection, const float *modelview);
+
+	// Check whether axis-aligned box from min to max is at least
+	// partially inside (conservative, may keep boxes just outside)
+	int intersects(const float *min, const float *max) const;
+};
+
+// Square block of cells (inclusive bounds) with world-space bounding box,
+// greatest height error of each detail level and level selected to draw
+struct TerrainChunk
+{
+	int minX, minZ, maxX, maxZ;
+	float boxMin[3], boxMax[3];
+	float errors[maxChunkLevels];
+	int level;
+};
+
+// Terrain cells split into fixed-size chunks for culling and level of
+// detail, chunk (i, j)
+// covers cell rows i * chunkSize onwards and columns j * chunkSize onwards
+class TerrainChunks
+{
+public:
+	// Grid size in points, chunk size in cells, world position of point
+	// (0, 0) and extra height to include above terrain
+	TerrainChunks(int gridSize, int chunkSize, float origin, float margin);
+	~TerrainChunks(); // Destructor
+
+	int gridSize, chunkSize;
+	int perSide, count, levels;
+	TerrainChunk *chunks;
+
+	// Chunk indices that passed last cull and their number of cells
+	int *visible;
+	int visibleCount;
+	long visibleCells;
+
+	// Recompute height bounds and level errors of chunks containing
+	// points in region
+	void updateBounds(TerrainGrid &grid, GridRegion region);
+
+	// Fill visible chunk list with chunks intersecting frustum
+	void cull(const Frustum &frustum);
+
+	// Mark every chunk as visible
+	void showAll();
+
+	// Select coarsest level of each chunk whose error, projected from
+	// nearest point of box to camera position, stays within threshold
+	// (pixel scale is pixels per unit of error at distance 1), or finest
+	// level everywhere if threshold is 0
+	void selectLevels(const float *camera, float pixelScale,
+		float threshold);
+
+	// Steps each side of chunk is split to so it meets its neighbors
+	// (lower x, upper x, lower z, upper z): step of finer neighbor, or
+	// own step next to coarser neighbor or edge of grid
+	void levelSplits(int index, int *splits);
+
+	// Append grid point indices (x * grid size + z) of triangles for
+	// chunk at its selected level above finest, edges next to finer
+	// chunks are split to match them so levels meet without cracks
+	void appendLevelTriangles(int index, std::vector<unsigned int> &indices);
+
+private:
+	float margin;
+
+	// Greatest height difference between grid points of chunk and
+	// triangles sampling every step points
+	float levelError(TerrainGrid &grid, TerrainChunk &chunk, int step);
+
+	// Step of chunk (i, j), or 0 past edge of grid
+	int chunkStep(int i, int j);
+
+	// Append triangles of cell from (x0, z0) to (x1, z1) with sides split
+	// every given number of points (lower x, upper x, lower z, upper z)
+	void appendCell(std::vector<unsigned int> &indices, int x0, int z0,
+		int x1, int z1, const int *splits);
+};
+
+#endif
@@ -0,0 +1,333 @@
+// Standard C++ library imports
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// Local imports
+#include "terrainFilter.h"
+#include "threadPool.h"
+
+// Names of all filters, in order usually applied
+const char *TerrainFilter::names[] =
+{
+	"gaussian", "thermal", "hydraulic", NULL
+};
+
+// Create filter by name, NULL if unknown
+TerrainFilter *TerrainFilter::create(const char *name)
+{
+	if (strcmp(name, "gaussian") == 0)
+		return new GaussianFilter();
+	if (strcmp(name, "thermal") == 0)
+		return new ThermalErosionFilter();
+	if (strcmp(name, "hydraulic") == 0)
+		return new HydraulicErosionFilter();
+	return NULL;
+}
+
+// Gaussian filter with weights out to three standard deviations
+GaussianFilter::GaussianFilter(float sigma)
+{
+	int radius = ceilf(sigma * 3);
+	float total = 0;
+	for (int k = -radius; k <= radius; k++)
+	{
+		weights.push_back(expf(-0.5f * k * k / (sigma * sigma)));
+		total += weights.back();
+	}
+	for (size_t k = 0; k < weights.size(); k++)
+		weights[k] /= total;
+}
+
+// One buffer of blurred rows
+size_t GaussianFilter::scratchBytes(int size)
+{
+	return (size_t)size * size * sizeof(float);
+}
+
+// Blur along rows into buffer, then along columns back into heights a
+// whole row at a time, points beyond grid edges repeat edge points
+void GaussianFilter::apply(TerrainGrid &grid, ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+	int size = grid.size, radius = weights.size() / 2;
+	std::vector<float> blurred((size_t)size * size);
+
+	// Along z within each row
+	pool->forRows(size, [&](int first, int last)
+	{
+		for (int x = first; x <= last; x++)
+		{
+			const float *in = &grid.heights[grid.index(x, 0)];
+			float *out = &blurred[grid.index(x, 0)];
+			for (int z = 0; z < size; z++)
+			{
+				float sum = 0;
+				for (int k = -radius; k <= radius; k++)
+				{
+					int j = z + k < 0 ? 0 : z + k < size ? z + k : size - 1;
+					sum += weights[k + radius] * in[j];
+				}
+				out[z] = sum;
+			}
+		}
+	});
+
+	// Along x, each output row sums whole neighboring rows
+	pool->forRows(size, [&](int first, int last)
+	{
+		for (int x = first; x <= last; x++)
+		{
+			float *out = &grid.heights[grid.index(x, 0)];
+			for (int z = 0; z < size; z++)
+				out[z] = 0;
+			for (int k = -radius; k <= radius; k++)
+			{
+				int i = x + k < 0 ? 0 : x + k < size ? x + k : size - 1;
+				const float *in = &blurred[grid.index(i, 0)];
+				float weight = weights[k + radius];
+				for (int z = 0; z < size; z++)
+					out[z] += weight * in[z];
+			}
+		}
+	});
+	grid.findGreatestHeight();
+}
+
+// Thermal erosion filter with given iterations, talus and rate
+ThermalErosionFilter::ThermalErosionFilter(int iterations, float talus,
+	float rate)
+{
+	this->iterations = iterations;
+	this->talus = talus;
+	this->rate = rate;
+}
+
+// Second height buffer
+size_t ThermalErosionFilter::scratchBytes(int size)
+{
+	return (size_t)size * size * sizeof(float);
+}
+
+// Material exchanged between point of height h and neighbor of height n,
+// positive if gained; the same amount is lost by neighbor, so total height
+// stays the same. Difference beyond talus either way written with absolute
+// values only, which keeps the loop free of branches so it vectorizes
+static inline float slide(float h, float n, float talus, float rate)
+{
+	float d = n - h;
+	return rate * (d + 0.5f * (fabsf(d - talus) - fabsf(d + talus)));
+}
+
+// Alternate between heights and buffer, every point gathering exchanges
+// with its four neighbors (none across grid edges)
+void ThermalErosionFilter::apply(TerrainGrid &grid, ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+	int size = grid.size;
+	float limit = talus * grid.greatestHeight / size, rate = this->rate;
+	std::vector<float> buffer((size_t)size * size);
+	float *source = grid.heights, *target = buffer.data();
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		// Constants captured by value, so stores to heights cannot alias them
+		pool->forRows(size, [&, limit, rate](int first, int last)
+		{
+			for (int x = first; x <= last; x++)
+			{
+				// Missing rows beyond edges stand in as current row,
+				// which exchanges nothing
+				const float *row = source + grid.index(x, 0);
+				const float *up = x > 0 ? row - size : row;
+				const float *down = x < size - 1 ? row + size : row;
+				float *out = target + grid.index(x, 0);
+				for (int z = 1; z < size - 1; z++)
+				{
+					float h = row[z];
+					out[z] = h + slide(h, up[z], limit, rate)
+						+ slide(h, down[z], limit, rate)
+						+ slide(h, row[z - 1], limit, rate)
+						+ slide(h, row[z + 1], limit, rate);
+				}
+
+				// First and last points lack one neighbor each
+				int end = size - 1;
+				out[0] = row[0] + slide(row[0], up[0], limit, rate)
+					+ slide(row[0], down[0], limit, rate)
+					+ slide(row[0], row[1], limit, rate);
+				out[end] = row[end] + slide(row[end], up[end], limit, rate)
+					+ slide(row[end], down[end], limit, rate)
+					+ slide(row[end], row[end - 1], limit, rate);
+			}
+		});
+		std::swap(source, target);
+	}
+
+	// Odd number of iterations ends in buffer
+	if (source != grid.heights)
+		memcpy(grid.heights, source, (size_t)size * size * sizeof(float));
+	grid.findGreatestHeight();
+}
+
+// Hydraulic erosion filter with given iterations
+HydraulicErosionFilter::HydraulicErosionFilter(int iterations)
+{
+	this->iterations = iterations;
+}
+
+// Water, sediment (or capacity), sediment per water, room to lowest
+// neighbor and outflow in four directions for every point
+size_t HydraulicErosionFilter::scratchBytes(int size)
+{
+	return (size_t)size * size * sizeof(float) * 8;
+}
+
+// Rain per iteration relative to greatest height, share of surface drop
+// that flows out per iteration, sediment capacity per water moved and
+// height dropped, rates of dissolving, depositing and evaporating
+static const float rainRate = 0.0002f;
+static const float flowRate = 0.25f;
+static const float capacityRate = 1.0f;
+static const float dissolveRate = 0.3f;
+static const float depositRate = 0.3f;
+static const float evaporateRate = 0.05f;
+
+// Larger and smaller of two values written without branches
+static inline float larger(float a, float b)
+{
+	return 0.5f * (a + b + fabsf(a - b));
+}
+static inline float smaller(float a, float b)
+{
+	return 0.5f * (a + b - fabsf(a - b));
+}
+
+// Buffers of hydraulic erosion, one value per point, outflow in four
+// planes (towards lower x, higher x, lower z, higher z); sediment of a
+// point is only needed by the point itself, so it is replaced by capacity
+// between finding outflow and gathering inflow
+struct WaterState
+{
+	float *heights, *water, *sediment, *ratio, *room;
+	float *flow[4];
+	float rain;
+};
+
+// Outflow of point split between lower neighbors at given offsets by
+// surface drop; a missing neighbor has offset 0, so its drop is 0
+static inline void outflow(const WaterState &s, size_t p, ptrdiff_t up,
+	ptrdiff_t down, ptrdiff_t left, ptrdiff_t right)
+{
+	ptrdiff_t offsets[4] = { up, down, left, right };
+	float depth = s.water[p] + s.rain;
+	float surface = s.heights[p] + depth, drops[4], total = 0;
+	float lowest = s.heights[p];
+	for (int k = 0; k < 4; k++)
+	{
+		size_t q = p + offsets[k];
+		drops[k] = larger(surface - s.heights[q] - s.water[q] - s.rain, 0);
+		total += drops[k];
+		lowest = smaller(lowest, s.heights[q]);
+	}
+
+	// Without any drop nothing moves, tiny total only avoids dividing by 0
+	float moved = smaller(depth, total * flowRate);
+	float share = moved / (total + 1e-30f);
+	for (int k = 0; k < 4; k++)
+		s.flow[k][p] = share * drops[k];
+	s.ratio[p] = depth > 0 ? s.sediment[p] / depth : 0;
+	s.sediment[p] = capacityRate * moved * total;
+	s.room[p] = lowest - s.heights[p];
+}
+
+// Inflow of point is outflow of its neighbors in opposite direction,
+// weighted by whether they exist; sediment moves along with water
+static inline void gather(const WaterState &s, size_t p, ptrdiff_t up,
+	ptrdiff_t down, ptrdiff_t left, ptrdiff_t right, const float exists[4])
+{
+	ptrdiff_t offsets[4] = { up, down, left, right };
+	float out = 0, in = 0, sedimentIn = 0;
+	for (int k = 0; k < 4; k++)
+	{
+		size_t q = p + offsets[k];
+		float inflow = exists[k] * s.flow[k ^ 1][q];
+		out += s.flow[k][p];
+		in += inflow;
+		sedimentIn += inflow * s.ratio[q];
+	}
+	float remaining = s.water[p] + s.rain - out;
+	float depth = remaining + in;
+	float carried = remaining * s.ratio[p] + sedimentIn;
+
+	// Dissolve ground below capacity, deposit above it; never cut more
+	// than halfway down to lowest neighbor or fill above it, which would
+	// let heights run away
+	float excess = carried - s.sediment[p], room = s.room[p];
+	float change = smaller(depositRate * larger(excess, 0), larger(room, 0))
+		+ larger(dissolveRate * smaller(excess, 0), 0.5f * smaller(room, 0));
+	s.heights[p] += change;
+	s.sediment[p] = carried - change;
+	s.water[p] = depth * (1 - evaporateRate);
+}
+
+// Each iteration first finds outflow of every point to lower neighbors,
+// then every point gathers inflow from its neighbors and dissolves or
+// deposits sediment. Points inside a row have fixed neighbor offsets, only
+// first and last point of each row miss a neighbor
+void HydraulicErosionFilter::apply(TerrainGrid &grid, ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+	int size = grid.size;
+	size_t points = (size_t)size * size;
+	std::vector<float> water(points, 0), sediment(points, 0);
+	std::vector<float> ratio(points), room(points);
+	std::vector<float> flow(points * 4);
+	WaterState state = { grid.heights, water.data(), sediment.data(),
+		ratio.data(), room.data(), { &flow[0],
+		&flow[points], &flow[points * 2], &flow[points * 3] },
+		rainRate * grid.greatestHeight };
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		for (int phase = 0; phase < 2; phase++)
+		{
+			pool->forRows(size, [&](int first, int last)
+			{
+				// Local copy, so stores to heights cannot alias rain
+				WaterState s = state;
+				for (int x = first; x <= last; x++)
+				{
+					float above = x > 0, below = x < size - 1;
+					ptrdiff_t up = above ? -size : 0, down = below ? size : 0;
+					float firstExists[4] = { above, below, 0, 1 };
+					float exists[4] = { above, below, 1, 1 };
+					float lastExists[4] = { above, below, 1, 0 };
+					size_t row = grid.index(x, 0), end = row + size - 1;
+					if (phase == 0)
+					{
+						outflow(s, row, up, down, 0, 1);
+						for (size_t p = row + 1; p < end; p++)
+							outflow(s, p, up, down, -1, 1);
+						outflow(s, end, up, down, -1, 0);
+					}
+					else
+					{
+						gather(s, row, up, down, 0, 1, firstExists);
+						for (size_t p = row + 1; p < end; p++)
+							gather(s, p, up, down, -1, 1, exists);
+						gather(s, end, up, down, -1, 0, lastExists);
+					}
+				}
+			});
+		}
+	}
+
+	// Sediment still carried settles where it is
+	for (size_t p = 0; p < points; p++)
+		grid.heights[p] += sediment[p];
+	grid.findGreatestHeight();
+}
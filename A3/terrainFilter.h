@@ -0,0 +1,82 @@
+#ifndef TERRAINFILTER_H
+#define TERRAINFILTER_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "terrainGrid.h"
+
+class ThreadPool;
+
+// Post-process pass over generated heights, e.g. smoothing or erosion;
+// rows are split into bands across threads and every point reads the
+// previous state only, so results do not depend on number of threads
+class TerrainFilter
+{
+public:
+	virtual ~TerrainFilter() {}
+
+	// Name used to select filter
+	virtual const char *name() = 0;
+
+	// Filter heights of grid and update greatest height, in parallel on
+	// given pool (shared pool if NULL)
+	virtual void apply(TerrainGrid &grid, ThreadPool *pool = NULL) = 0;
+
+	// Temporary bytes needed beyond grid while filtering
+	virtual size_t scratchBytes(int size) = 0;
+
+	// Create filter by name (gaussian, thermal, hydraulic), NULL if unknown
+	static TerrainFilter *create(const char *name);
+
+	// Names of all filters, NULL terminated
+	static const char *names[];
+};
+
+// Separable Gaussian blur, rows then columns through a second buffer
+class GaussianFilter : public TerrainFilter
+{
+public:
+	GaussianFilter(float sigma = 2); // Standard deviation in grid units
+	const char *name() { return "gaussian"; }
+	void apply(TerrainGrid &grid, ThreadPool *pool = NULL);
+	size_t scratchBytes(int size);
+
+private:
+	std::vector<float> weights;
+};
+
+// Thermal erosion: material slides from each point to lower neighbors
+// where slope exceeds talus angle, heights alternate between two buffers
+class ThermalErosionFilter : public TerrainFilter
+{
+public:
+	// Number of iterations, talus slope as multiple of greatest height
+	// over grid size, fraction of excess moved per iteration
+	ThermalErosionFilter(int iterations = 50, float talus = 2,
+		float rate = 0.1);
+	const char *name() { return "thermal"; }
+	void apply(TerrainGrid &grid, ThreadPool *pool = NULL);
+	size_t scratchBytes(int size);
+
+private:
+	int iterations;
+	float talus, rate;
+};
+
+// Hydraulic erosion: rain flows downhill, dissolving ground where water
+// can carry more sediment and depositing it where it can carry less;
+// outflow of every point is computed first, then gathered by neighbors
+class HydraulicErosionFilter : public TerrainFilter
+{
+public:
+	HydraulicErosionFilter(int iterations = 100); // Number of iterations
+	const char *name() { return "hydraulic"; }
+	void apply(TerrainGrid &grid, ThreadPool *pool = NULL);
+	size_t scratchBytes(int size);
+
+private:
+	int iterations;
+};
+
+#endif
@@ -0,0 +1,281 @@
+// Standard C++ library imports
+#include <math.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+// Vector intrinsics when enabled by compiler flags
+#if defined(__AVX__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+// Local imports
+#include "terrainGenerator.h"
+#include "terrainRandom.h"
+#include "threadPool.h"
+
+// Names of all generators, first is default
+const char *TerrainGenerator::names[] =
+{
+	"circles", "faults", "diamond", NULL
+};
+
+// Create generator by name, NULL if unknown
+TerrainGenerator *TerrainGenerator::create(const char *name)
+{
+	if (strcmp(name, "circles") == 0)
+		return new CirclesGenerator();
+	if (strcmp(name, "faults") == 0)
+		return new FaultLineGenerator();
+	if (strcmp(name, "diamond") == 0)
+		return new DiamondSquareGenerator();
+	return NULL;
+}
+
+// Shift and scale heights to range from 0 to top
+void TerrainGenerator::normalizeHeights(TerrainGrid &grid, float top,
+	ThreadPool *pool)
+{
+	// Lowest and highest points, rows in parallel
+	std::mutex mutex;
+	float lowest = grid.heights[0], highest = grid.heights[0];
+	pool->forRows(grid.size, [&](int first, int last)
+	{
+		float low = grid.height(first, 0), high = low;
+		for (int x = first; x <= last; x++)
+		{
+			float *row = &grid.heights[grid.index(x, 0)];
+			for (int z = 0; z < grid.size; z++)
+			{
+				low = row[z] < low ? row[z] : low;
+				high = row[z] > high ? row[z] : high;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		lowest = low < lowest ? low : lowest;
+		highest = high > highest ? high : highest;
+	});
+
+	// Flat terrain stays at 0
+	float scale = highest > lowest ? top / (highest - lowest) : 0;
+	pool->forRows(grid.size, [&](int first, int last)
+	{
+		for (int x = first; x <= last; x++)
+		{
+			float *row = &grid.heights[grid.index(x, 0)];
+			for (int z = 0; z < grid.size; z++)
+				row[z] = (row[z] - lowest) * scale;
+		}
+	});
+	grid.greatestHeight = highest > lowest ? top : 0;
+}
+
+// Circles algorithm is part of grid, since sculpting also adds circles
+void CirclesGenerator::generate(TerrainGrid &grid, uint64_t seed,
+	ThreadPool *pool)
+{
+	grid.generateCircles(seed, pool);
+}
+
+// Fault-line generator with given number of faults
+FaultLineGenerator::FaultLineGenerator(int faults)
+{
+	this->faults = faults;
+}
+
+// Add displacement times signed distance from fault (clamped from -1 to 1)
+// to each point of row, side is distance at first point and slope the
+// change per point
+static void addFaultRow(float *row, int size, float side, float slope,
+	float displacement)
+{
+	int z = 0;
+#if defined(__AVX__)
+	// Eight points per iteration
+	__m256 offsets = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+	__m256 one = _mm256_set1_ps(1), minusOne = _mm256_set1_ps(-1);
+	__m256 step = _mm256_set1_ps(slope);
+	__m256 scale = _mm256_set1_ps(displacement);
+	for (; z + 8 <= size; z += 8)
+	{
+		__m256 zs = _mm256_add_ps(_mm256_set1_ps(z), offsets);
+		__m256 s = _mm256_add_ps(_mm256_set1_ps(side),
+			_mm256_mul_ps(step, zs));
+		s = _mm256_max_ps(_mm256_min_ps(s, one), minusOne);
+		_mm256_storeu_ps(row + z, _mm256_add_ps(_mm256_loadu_ps(row + z),
+			_mm256_mul_ps(scale, s)));
+	}
+#elif defined(__SSE2__)
+	// Four points per iteration
+	__m128 offsets = _mm_set_ps(3, 2, 1, 0);
+	__m128 one = _mm_set1_ps(1), minusOne = _mm_set1_ps(-1);
+	__m128 step = _mm_set1_ps(slope);
+	__m128 scale = _mm_set1_ps(displacement);
+	for (; z + 4 <= size; z += 4)
+	{
+		__m128 zs = _mm_add_ps(_mm_set1_ps(z), offsets);
+		__m128 s = _mm_add_ps(_mm_set1_ps(side), _mm_mul_ps(step, zs));
+		s = _mm_max_ps(_mm_min_ps(s, one), minusOne);
+		_mm_storeu_ps(row + z, _mm_add_ps(_mm_loadu_ps(row + z),
+			_mm_mul_ps(scale, s)));
+	}
+#endif
+
+	// Remaining points (or all points without vector instructions)
+	for (; z < size; z++)
+	{
+		float s = side + slope * z;
+		s = s < 1 ? s : 1;
+		s = s > -1 ? s : -1;
+		row[z] += displacement * s;
+	}
+}
+
+// Apply every fault to each row in turn, so rows stay in cache and bands
+// of rows can run on separate threads
+void FaultLineGenerator::generate(TerrainGrid &grid, uint64_t seed,
+	ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+	grid.seed = seed;
+	int size = grid.size;
+
+	// Fault line i through random point at random angle, written as
+	// normal (a, b) and offset c, scaled so the slope across the fault
+	// spans a few cells
+	struct Fault { float a, b, c, displacement; };
+	std::vector<Fault> lines(faults);
+	float width = size / 64.0f + 1;
+	for (int i = 0; i < faults; i++)
+	{
+		float angle = randomFloat(seed, (uint64_t)i * 3) * 2 * M_PI;
+		float pointX = randomFloat(seed, (uint64_t)i * 3 + 1) * size;
+		float pointZ = randomFloat(seed, (uint64_t)i * 3 + 2) * size;
+		lines[i].a = cos(angle) / width;
+		lines[i].b = sin(angle) / width;
+		lines[i].c = lines[i].a * pointX + lines[i].b * pointZ;
+		lines[i].displacement = 1 - (float)i / faults;
+	}
+
+	// Raise points on positive side, lower points on negative side
+	pool->forRows(size, [&](int first, int last)
+	{
+		for (int x = first; x <= last; x++)
+		{
+			float *row = &grid.heights[grid.index(x, 0)];
+			for (int z = 0; z < size; z++)
+				row[z] = 0;
+			for (int i = 0; i < faults; i++)
+			{
+				addFaultRow(row, size, lines[i].a * x - lines[i].c,
+					lines[i].b, lines[i].displacement);
+			}
+		}
+	});
+
+	normalizeHeights(grid, size / 20.0f, pool);
+}
+
+// Diamond-square generator with given falloff of displacement per level
+DiamondSquareGenerator::DiamondSquareGenerator(float roughness)
+{
+	this->roughness = roughness;
+}
+
+// Smallest 2^k + 1 at least given size
+int DiamondSquareGenerator::coveringSize(int size)
+{
+	int covering = 2;
+	while (covering + 1 < size)
+		covering *= 2;
+	return covering + 1;
+}
+
+// Scratch grid of covering size
+size_t DiamondSquareGenerator::scratchBytes(int size)
+{
+	size_t covering = coveringSize(size);
+	return covering * covering * sizeof(float);
+}
+
+// Each level sets centers of squares (diamond step) then midpoints of
+// edges (square step), every point set once with its own random offset
+void DiamondSquareGenerator::generate(TerrainGrid &grid, uint64_t seed,
+	ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+	grid.seed = seed;
+	int n = coveringSize(grid.size);
+	std::vector<float> map((size_t)n * n);
+
+	// Point in covering grid, and its random offset from -1 to 1 with
+	// point index as counter
+	auto cell = [&](int x, int z) -> float&
+		{ return map[(size_t)x * n + z]; };
+	auto offset = [&](int x, int z)
+		{ return randomFloat(seed, (uint64_t)x * n + z) * 2 - 1; };
+
+	// Random corners
+	int last = n - 1;
+	cell(0, 0) = offset(0, 0);
+	cell(0, last) = offset(0, last);
+	cell(last, 0) = offset(last, 0);
+	cell(last, last) = offset(last, last);
+
+	float amplitude = 1;
+	for (int step = n - 1; step > 1; step /= 2)
+	{
+		int half = step / 2;
+		int squares = (n - 1) / step;
+
+		// Diamond step: center of each square from its corners
+		pool->forRows(squares, [&](int first, int lastRow)
+		{
+			for (int i = first; i <= lastRow; i++)
+			{
+				int x = i * step + half;
+				for (int z = half; z < n; z += step)
+					cell(x, z) = (cell(x - half, z - half)
+						+ cell(x - half, z + half) + cell(x + half, z - half)
+						+ cell(x + half, z + half)) / 4
+						+ offset(x, z) * amplitude;
+			}
+		});
+
+		// Square step: midpoint of each edge from its neighbors, points
+		// at grid border have only three neighbors
+		pool->forRows((n - 1) / half + 1, [&](int first, int lastRow)
+		{
+			for (int i = first; i <= lastRow; i++)
+			{
+				int x = i * half;
+				for (int z = (i % 2 == 0) ? half : 0; z < n; z += step)
+				{
+					float sum = 0;
+					int count = 0;
+					if (x >= half) { sum += cell(x - half, z); count++; }
+					if (x + half < n) { sum += cell(x + half, z); count++; }
+					if (z >= half) { sum += cell(x, z - half); count++; }
+					if (z + half < n) { sum += cell(x, z + half); count++; }
+					cell(x, z) = sum / count + offset(x, z) * amplitude;
+				}
+			}
+		});
+
+		amplitude *= roughness;
+	}
+
+	// Crop covering grid to terrain
+	pool->forRows(grid.size, [&](int first, int lastRow)
+	{
+		for (int x = first; x <= lastRow; x++)
+			memcpy(&grid.heights[grid.index(x, 0)], &cell(x, 0),
+				grid.size * sizeof(float));
+	});
+
+	normalizeHeights(grid, grid.size / 20.0f, pool);
+}
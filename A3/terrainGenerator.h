@@ -0,0 +1,78 @@
+#ifndef TERRAINGENERATOR_H
+#define TERRAINGENERATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "terrainGrid.h"
+
+class ThreadPool;
+
+// Terrain generation algorithm filling grid heights from a seed, same
+// seed and grid size always give the same terrain
+class TerrainGenerator
+{
+public:
+	virtual ~TerrainGenerator() {}
+
+	// Name used to select generator
+	virtual const char *name() = 0;
+
+	// Fill heights and greatest height of grid, in parallel on given pool
+	// (shared pool if NULL)
+	virtual void generate(TerrainGrid &grid, uint64_t seed,
+		ThreadPool *pool = NULL) = 0;
+
+	// Temporary bytes needed beyond grid while generating
+	virtual size_t scratchBytes(int /* size */) { return 0; }
+
+	// Create generator by name (circles, faults, diamond), NULL if unknown
+	static TerrainGenerator *create(const char *name);
+
+	// Names of all generators, NULL terminated
+	static const char *names[];
+
+protected:
+	// Shift and scale heights to range from 0 to top
+	void normalizeHeights(TerrainGrid &grid, float top, ThreadPool *pool);
+};
+
+// Circles algorithm: cosine bumps of random size and position
+class CirclesGenerator : public TerrainGenerator
+{
+public:
+	const char *name() { return "circles"; }
+	void generate(TerrainGrid &grid, uint64_t seed, ThreadPool *pool = NULL);
+};
+
+// Fault-line algorithm: random lines raise one side and lower the other,
+// by less on each iteration
+class FaultLineGenerator : public TerrainGenerator
+{
+public:
+	FaultLineGenerator(int faults = 200); // Number of fault lines
+	const char *name() { return "faults"; }
+	void generate(TerrainGrid &grid, uint64_t seed, ThreadPool *pool = NULL);
+
+private:
+	int faults;
+};
+
+// Diamond-square algorithm: midpoint displacement on a 2^k + 1 grid that
+// covers the terrain, then cropped
+class DiamondSquareGenerator : public TerrainGenerator
+{
+public:
+	DiamondSquareGenerator(float roughness = 0.55); // Falloff per level
+	const char *name() { return "diamond"; }
+	void generate(TerrainGrid &grid, uint64_t seed, ThreadPool *pool = NULL);
+	size_t scratchBytes(int size);
+
+private:
+	float roughness;
+
+	// Points per side of square grid covering given size
+	static int coveringSize(int size);
+};
+
+#endif
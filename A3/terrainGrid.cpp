@@ -0,0 +1,888 @@
+// Standard C++ library imports
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <vector>
+
+// Vector intrinsics when enabled by compiler flags
+#if defined(__AVX__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+// Local imports
+#include "terrainGrid.h"
+#include "terrainRandom.h"
+#include "threadPool.h"
+
+// Bytes per cache line, each map starts on its own line
+static const size_t cacheLine = 64;
+
+// Round byte count up to a whole number of cache lines
+static size_t alignToCacheLine(size_t bytes)
+{
+	return (bytes + cacheLine - 1) / cacheLine * cacheLine;
+}
+
+// Append parts of piece outside cut to list: rows before and after cut
+// span the whole piece, rows beside it only the columns left and right
+static void subtractRegion(GridRegion piece, GridRegion cut,
+	std::vector<GridRegion> &parts)
+{
+	int minX = piece.minX > cut.minX ? piece.minX : cut.minX;
+	int minZ = piece.minZ > cut.minZ ? piece.minZ : cut.minZ;
+	int maxX = piece.maxX < cut.maxX ? piece.maxX : cut.maxX;
+	int maxZ = piece.maxZ < cut.maxZ ? piece.maxZ : cut.maxZ;
+	if (minX > maxX || minZ > maxZ)
+	{
+		parts.push_back(piece);
+		return;
+	}
+	GridRegion sides[4] =
+	{
+		{ piece.minX, piece.minZ, minX - 1, piece.maxZ },
+		{ maxX + 1, piece.minZ, piece.maxX, piece.maxZ },
+		{ minX, piece.minZ, maxX, minZ - 1 },
+		{ minX, maxZ + 1, maxX, piece.maxZ }
+	};
+	for (int i = 0; i < 4; i++)
+		if (sides[i].minX <= sides[i].maxX && sides[i].minZ <= sides[i].maxZ)
+			parts.push_back(sides[i]);
+}
+
+// Add region to list of disjoint regions, keeping only the parts of it
+// not already listed (regions it covers are replaced)
+void addDisjointRegion(std::vector<GridRegion> &regions, GridRegion region)
+{
+	if (region.minX > region.maxX || region.minZ > region.maxZ)
+		return;
+
+	// Listed regions inside new one are dropped, it is added whole
+	for (size_t i = 0; i < regions.size();)
+	{
+		GridRegion &listed = regions[i];
+		if (listed.minX >= region.minX && listed.maxX <= region.maxX
+			&& listed.minZ >= region.minZ && listed.maxZ <= region.maxZ)
+		{
+			listed = regions.back();
+			regions.pop_back();
+		}
+		else
+			i++;
+	}
+
+	// Cut every remaining listed region out of pieces of new region
+	std::vector<GridRegion> pieces(1, region), parts;
+	for (size_t i = 0; i < regions.size() && !pieces.empty(); i++)
+	{
+		parts.clear();
+		for (size_t j = 0; j < pieces.size(); j++)
+			subtractRegion(pieces[j], regions[i], parts);
+		pieces.swap(parts);
+	}
+	regions.insert(regions.end(), pieces.begin(), pieces.end());
+}
+
+// Allocate height, normal and color maps together for given grid size,
+// without height map if heights are stored elsewhere
+TerrainGrid::TerrainGrid(int size, float *heights)
+{
+	this->size = size;
+	this->seed = 0;
+	this->greatestHeight = 0;
+
+	// Size of height map and of each normal component plane
+	size_t points = (size_t)size * size;
+	size_t planeBytes = alignToCacheLine(points * sizeof(float));
+
+	// Single allocation aligned to cache line for height map, three
+	// normal maps of three components each and color map
+	int first = heights == NULL ? 0 : 1;
+	size_t colorBytes = alignToCacheLine(points * sizeof(uint32_t));
+	blockSize = planeBytes * (10 - first) + colorBytes;
+	if (posix_memalign(&block, cacheLine, blockSize) != 0)
+	{
+		fprintf(stderr, "Not able to allocate %d x %d grid.\n", size, size);
+		exit(EXIT_FAILURE);
+	}
+
+	// Carve planes out of allocation
+	float *planes[10];
+	for (int i = first; i < 10; i++)
+		planes[i] = (float*)((char*)block + planeBytes * (i - first));
+	this->heights = heights == NULL ? planes[0] : heights;
+	NormalMap triangleX = { planes[1], planes[2], planes[3] };
+	NormalMap triangleZ = { planes[4], planes[5], planes[6] };
+	NormalMap vertex = { planes[7], planes[8], planes[9] };
+	triangleXNormals = triangleX;
+	triangleZNormals = triangleZ;
+	squareNormals = triangleZ;
+	vertexNormals = vertex;
+	colors = (uint32_t*)((char*)block + planeBytes * (10 - first));
+
+	// Start from flat terrain unless heights were given
+	for (size_t i = 0; heights == NULL && i < points; i++)
+		this->heights[i] = 0;
+}
+
+// Clean-up of memory
+TerrainGrid::~TerrainGrid()
+{
+	free(block);
+}
+
+// Total bytes allocated for heights, normals and colors
+size_t TerrainGrid::bytes()
+{
+	return blockSize;
+}
+
+// Face normals for cells z0 to z1 of row x, one cell at a time; each
+// normal is the cross product of two edges and has y component 1
+void TerrainGrid::faceNormalRowScalar(int x, int z0, int z1)
+{
+	// Heights on current and next row
+	float *h0 = &heights[index(x, 0)];
+	float *h1 = &heights[index(x + 1, 0)];
+
+	// Output planes for current row
+	size_t row = index(x, 0);
+	float *xx = triangleXNormals.nx + row, *xy = triangleXNormals.ny + row;
+	float *xz = triangleXNormals.nz + row, *zx = triangleZNormals.nx + row;
+	float *zy = triangleZNormals.ny + row, *zz = triangleZNormals.nz + row;
+
+	for (int z = z0; z <= z1; z++)
+	{
+		// Triangle (x, z), (x + 1, z + 1), (x + 1, z)
+		xx[z] = h0[z] - h1[z];
+		xy[z] = 1;
+		xz[z] = h1[z] - h1[z + 1];
+
+		// Triangle (x, z), (x, z + 1), (x + 1, z + 1), also square
+		zx[z] = h0[z + 1] - h1[z + 1];
+		zy[z] = 1;
+		zz[z] = h0[z] - h0[z + 1];
+	}
+}
+
+// Face normals for cells z0 to z1 of row x, several cells at a time using
+// vector instructions, remaining cells use scalar code
+void TerrainGrid::faceNormalRowSimd(int x, int z0, int z1)
+{
+	// Heights on current and next row
+	float *h0 = &heights[index(x, 0)];
+	float *h1 = &heights[index(x + 1, 0)];
+
+	// Output planes for current row
+	size_t row = index(x, 0);
+	float *xx = triangleXNormals.nx + row, *xy = triangleXNormals.ny + row;
+	float *xz = triangleXNormals.nz + row, *zx = triangleZNormals.nx + row;
+	float *zy = triangleZNormals.ny + row, *zz = triangleZNormals.nz + row;
+
+	int z = z0;
+#if defined(__AVX__)
+	// Eight cells per iteration
+	__m256 one = _mm256_set1_ps(1);
+	for (; z + 7 <= z1; z += 8)
+	{
+		__m256 a = _mm256_loadu_ps(h0 + z), b = _mm256_loadu_ps(h0 + z + 1);
+		__m256 c = _mm256_loadu_ps(h1 + z), d = _mm256_loadu_ps(h1 + z + 1);
+		_mm256_storeu_ps(xx + z, _mm256_sub_ps(a, c));
+		_mm256_storeu_ps(xy + z, one);
+		_mm256_storeu_ps(xz + z, _mm256_sub_ps(c, d));
+		_mm256_storeu_ps(zx + z, _mm256_sub_ps(b, d));
+		_mm256_storeu_ps(zy + z, one);
+		_mm256_storeu_ps(zz + z, _mm256_sub_ps(a, b));
+	}
+#elif defined(__SSE2__)
+	// Four cells per iteration
+	__m128 one = _mm_set1_ps(1);
+	for (; z + 3 <= z1; z += 4)
+	{
+		__m128 a = _mm_loadu_ps(h0 + z), b = _mm_loadu_ps(h0 + z + 1);
+		__m128 c = _mm_loadu_ps(h1 + z), d = _mm_loadu_ps(h1 + z + 1);
+		_mm_storeu_ps(xx + z, _mm_sub_ps(a, c));
+		_mm_storeu_ps(xy + z, one);
+		_mm_storeu_ps(xz + z, _mm_sub_ps(c, d));
+		_mm_storeu_ps(zx + z, _mm_sub_ps(b, d));
+		_mm_storeu_ps(zy + z, one);
+		_mm_storeu_ps(zz + z, _mm_sub_ps(a, b));
+	}
+#endif
+
+	// Remaining cells (or all cells without vector instructions)
+	if (z <= z1)
+		faceNormalRowScalar(x, z, z1);
+}
+
+// Recompute face normals of cells in region a row at a time
+void TerrainGrid::computeFaceNormals(GridRegion cells, int simd)
+{
+	for (int x = cells.minX; x <= cells.maxX; x++)
+	{
+		if (simd)
+			faceNormalRowSimd(x, cells.minZ, cells.maxZ);
+		else
+			faceNormalRowScalar(x, cells.minZ, cells.maxZ);
+	}
+}
+
+// Color channel byte from value scaled to bytes, clamped and rounded
+static inline uint32_t colorByte(float value)
+{
+	value = value < 0 ? 0 : value > 255 ? 255 : value;
+	return (uint32_t)(value + 0.5f);
+}
+
+// Colors of points z0 to z1 of row x one point at a time, bytes in
+// memory order red, green, blue, alpha
+void TerrainGrid::colorRowScalar(int x, int z0, int z1, const float *base,
+	const float *slope)
+{
+	float *h = &heights[index(x, 0)];
+	uint32_t *row = &colors[index(x, 0)];
+	for (int z = z0; z <= z1; z++)
+		row[z] = colorByte(base[0] + h[z] * slope[0])
+			| colorByte(base[1] + h[z] * slope[1]) << 8
+			| colorByte(base[2] + h[z] * slope[2]) << 16 | 0xff000000u;
+}
+
+// Colors of points z0 to z1 of row x, four points at a time using vector
+// instructions (integer packing needs no AVX2), remaining points use
+// scalar code
+void TerrainGrid::colorRowSimd(int x, int z0, int z1, const float *base,
+	const float *slope)
+{
+	int z = z0;
+#if defined(__SSE2__)
+	float *h = &heights[index(x, 0)];
+	uint32_t *row = &colors[index(x, 0)];
+	__m128 zero = _mm_setzero_ps(), top = _mm_set1_ps(255);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128i alpha = _mm_set1_epi32(0xff000000u);
+	__m128 bases[3], slopes[3];
+	for (int i = 0; i < 3; i++)
+	{
+		bases[i] = _mm_set1_ps(base[i]);
+		slopes[i] = _mm_set1_ps(slope[i]);
+	}
+	for (; z + 3 <= z1; z += 4)
+	{
+		// Same clamping and rounding as scalar code, channels shifted
+		// into place
+		__m128 height = _mm_loadu_ps(h + z);
+		__m128i color = alpha;
+		for (int i = 0; i < 3; i++)
+		{
+			__m128 value = _mm_add_ps(bases[i], _mm_mul_ps(height, slopes[i]));
+			value = _mm_min_ps(_mm_max_ps(value, zero), top);
+			__m128i channel = _mm_cvttps_epi32(_mm_add_ps(value, half));
+			color = _mm_or_si128(color, _mm_slli_epi32(channel, i * 8));
+		}
+		_mm_storeu_si128((__m128i*)(row + z), color);
+	}
+#endif
+	if (z <= z1)
+		colorRowScalar(x, z, z1, base, slope);
+}
+
+// Recompute colors of points in region as gradient from low to high color
+// by height relative to greatest height, rows split across threads
+void TerrainGrid::computeColors(GridRegion region, const float *lowColor,
+	const float *highColor, int simd)
+{
+	// Color at height 0 and change per unit height, in bytes (flat
+	// terrain gets low color)
+	float inverse = greatestHeight > 0 ? 1 / greatestHeight : 0;
+	float base[3], slope[3];
+	for (int i = 0; i < 3; i++)
+	{
+		base[i] = lowColor[i] * 255;
+		slope[i] = (highColor[i] - lowColor[i]) * 255 * inverse;
+	}
+
+	if (region.minX > region.maxX || region.minZ > region.maxZ)
+		return;
+	ThreadPool::shared().forRows(region.maxX - region.minX + 1,
+		[&](int first, int last)
+	{
+		for (int x = region.minX + first; x <= region.minX + last; x++)
+		{
+			if (simd)
+				colorRowSimd(x, region.minZ, region.maxZ, base, slope);
+			else
+				colorRowScalar(x, region.minZ, region.maxZ, base, slope);
+		}
+	});
+}
+
+// Add face normal at cell (x, z) to accumulated vertex normal
+void TerrainGrid::addFaceNormal(NormalMap &map, int x, int z, float *normal)
+{
+	size_t i = index(x, z);
+	normal[0] += map.nx[i];
+	normal[1] += map.ny[i];
+	normal[2] += map.nz[i];
+}
+
+// Recompute normals depending on polygons and shading, limited to the
+// faces and vertices affected by height changes within given region
+void TerrainGrid::computeNormals(GridRegion region, int triangles, int smooth)
+{
+	// Faces touching a changed point start one cell before the region
+	int faceMinX = region.minX > 0 ? region.minX - 1 : 0;
+	int faceMinZ = region.minZ > 0 ? region.minZ - 1 : 0;
+	int faceMaxX = region.maxX < size - 2 ? region.maxX : size - 2;
+	int faceMaxZ = region.maxZ < size - 2 ? region.maxZ : size - 2;
+
+	// Compute affected face normals first
+	GridRegion faces = { faceMinX, faceMinZ, faceMaxX, faceMaxZ };
+	computeFaceNormals(faces, 1);
+
+	// Skip vertex normal computation for flat shading
+	if (!smooth)
+		return;
+
+	// Vertices touching a changed face extend one cell past the region
+	int vertexMinX = region.minX > 0 ? region.minX - 1 : 0;
+	int vertexMinZ = region.minZ > 0 ? region.minZ - 1 : 0;
+	int vertexMaxX = region.maxX < size - 2 ? region.maxX + 1 : size - 1;
+	int vertexMaxZ = region.maxZ < size - 2 ? region.maxZ + 1 : size - 1;
+	GridRegion vertices = { vertexMinX, vertexMinZ, vertexMaxX, vertexMaxZ };
+	computeVertexNormals(vertices, triangles);
+}
+
+// Vertex normal at (x, z) from faces around it, assume upward face
+// normals if outside grid (used for points on grid edges)
+void TerrainGrid::edgeVertexNormal(int x, int z, int triangles)
+{
+	// Accumulate normal, will be normalized by GL_NORMALIZE
+	float normal[3] = { 0, 0, 0 };
+
+	// Different faces for squares
+	if (!triangles)
+	{
+		// Square face at (x - 1, z - 1)
+		if (x >= 1 && z >= 1)
+			addFaceNormal(squareNormals, x - 1, z - 1, normal);
+		else
+			normal[1] += 1;
+
+		// Square face at (x, z - 1)
+		if (x < size - 1 && z >= 1)
+			addFaceNormal(squareNormals, x, z - 1, normal);
+		else
+			normal[1] += 1;
+
+		// Square face at (x - 1, z)
+		if (x >= 1 && z < size - 1)
+			addFaceNormal(squareNormals, x - 1, z, normal);
+		else
+			normal[1] += 1;
+
+		// Square face at (x, z)
+		if (x < size - 1 && z < size - 1)
+			addFaceNormal(squareNormals, x, z, normal);
+		else
+			normal[1] += 1;
+	}
+
+	//  Different faces for triangles
+	if (triangles)
+	{
+		// Triangle pointing to x axis at (x - 1, z - 1)
+		if (x >= 1 && z >= 1)
+			addFaceNormal(triangleXNormals, x - 1, z - 1, normal);
+		else
+			normal[1] += 1;
+
+		// Triangle pointing to z axis at (x - 1, z - 1)
+		if (x >= 1 && z >= 1)
+			addFaceNormal(triangleZNormals, x - 1, z - 1, normal);
+		else
+			normal[1] += 1;
+
+		// Triangle pointing to z axis at (x, z - 1)
+		if (x < size - 1 && z >= 1)
+			addFaceNormal(triangleZNormals, x, z - 1, normal);
+		else
+			normal[1] += 1;
+
+		// Triangle pointing to x axis at (x - 1, z)
+		if (x >= 1 && z < size - 1)
+			addFaceNormal(triangleXNormals, x - 1, z, normal);
+		else
+			normal[1] += 1;
+
+		// Triangle pointing to x axis at (x, z)
+		if (x < size - 1 && z < size - 1)
+			addFaceNormal(triangleXNormals, x, z, normal);
+		else
+			normal[1] += 1;
+
+		// Triangle pointing to z axis at (x, z)
+		if (x < size - 1 && z < size - 1)
+			addFaceNormal(triangleZNormals, x, z, normal);
+		else
+			normal[1] += 1;
+	}
+
+	// Set value in vertex normal map
+	size_t i = index(x, z);
+	vertexNormals.nx[i] = normal[0];
+	vertexNormals.ny[i] = normal[1];
+	vertexNormals.nz[i] = normal[2];
+}
+
+// Vertex normals for interior points z0 to z1 of interior row x, one
+// component plane at a time without branches, faces added in the same
+// order as on edges so results are identical
+void TerrainGrid::vertexNormalRow(int x, int z0, int z1, int triangles)
+{
+	size_t previous = index(x - 1, 0), current = index(x, 0);
+	float *outputs[3] = { vertexNormals.nx, vertexNormals.ny,
+		vertexNormals.nz };
+	float *xPlanes[3] = { triangleXNormals.nx, triangleXNormals.ny,
+		triangleXNormals.nz };
+	float *zPlanes[3] = { triangleZNormals.nx, triangleZNormals.ny,
+		triangleZNormals.nz };
+	for (int c = 0; c < 3; c++)
+	{
+		// Squares share planes with triangles pointing to z axis
+		float *out = outputs[c] + current;
+		const float *x0 = xPlanes[c] + previous, *x1 = xPlanes[c] + current;
+		const float *s0 = zPlanes[c] + previous, *s1 = zPlanes[c] + current;
+		if (triangles)
+			for (int z = z0; z <= z1; z++)
+				out[z] = x0[z - 1] + s0[z - 1] + s1[z - 1] + x0[z] + x1[z]
+					+ s1[z];
+		else
+			for (int z = z0; z <= z1; z++)
+				out[z] = s0[z - 1] + s1[z - 1] + s0[z] + s1[z];
+	}
+}
+
+// Recompute vertex normals of points in region from face normals,
+// interior rows split across threads, then points on grid edges
+void TerrainGrid::computeVertexNormals(GridRegion vertices, int triangles,
+	ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+
+	// Interior points have all faces around them
+	int minX = vertices.minX > 1 ? vertices.minX : 1;
+	int maxX = vertices.maxX < size - 2 ? vertices.maxX : size - 2;
+	int minZ = vertices.minZ > 1 ? vertices.minZ : 1;
+	int maxZ = vertices.maxZ < size - 2 ? vertices.maxZ : size - 2;
+	if (minX <= maxX && minZ <= maxZ)
+		pool->forRows(maxX - minX + 1, [&](int first, int last)
+		{
+			for (int x = minX + first; x <= minX + last; x++)
+				vertexNormalRow(x, minZ, maxZ, triangles);
+		});
+
+	// Points on edges of grid within region
+	for (int x = vertices.minX; x <= vertices.maxX; x++)
+	{
+		int edgeRow = x == 0 || x == size - 1;
+		for (int z = vertices.minZ; z <= vertices.maxZ; z++)
+			if (edgeRow || z == 0 || z == size - 1)
+				edgeVertexNormal(x, z, triangles);
+	}
+}
+
+// Greatest height within rows first to last, 0 if all heights are lower
+float TerrainGrid::greatestHeightInRows(int first, int last,
+	int minZ, int maxZ)
+{
+	float greatest = 0;
+	for (int x = first; x <= last; x++)
+	{
+		float *row = &heights[index(x, 0)];
+		for (int z = minZ; z <= maxZ; z++)
+			greatest = row[z] > greatest ? row[z] : greatest;
+	}
+	return greatest;
+}
+
+// Find greatest height by scanning every point in grid, rows in parallel
+void TerrainGrid::findGreatestHeight()
+{
+	std::mutex mutex;
+	greatestHeight = 0;
+	ThreadPool::shared().forRows(size, [&](int first, int last)
+	{
+		float greatest = greatestHeightInRows(first, last, 0, size - 1);
+		std::lock_guard<std::mutex> lock(mutex);
+		greatestHeight = fmaxf(greatestHeight, greatest);
+	});
+}
+
+// Taylor series coefficients of cos(pi * sqrt(t)) in t
+static const float cosPiSqrtTerms[] =
+{
+	1.0f, -4.934802201f, 4.058712126f, -1.335262769f, 0.2353306303f,
+	-0.02580689139f, 0.001929574309f, -0.0001046381049f,
+	0.000004303069587f, -0.0000001387895246f
+};
+
+// Cosine bump profile cos(pi * sqrt(t)) for squared normalized distance t
+// from 0 to 1, as Taylor series in t (no sqrt or cos needed per point)
+static inline float cosPiSqrt(float t)
+{
+	const float *c = cosPiSqrtTerms;
+	return c[0] + t * (c[1] + t * (c[2] + t * (c[3] + t * (c[4]
+		+ t * (c[5] + t * (c[6] + t * (c[7] + t * (c[8] + t * c[9]))))))));
+}
+
+// Add cosine bump to points z0 to z1 of row, dz is distance from circle
+// center to first point and dx2 the squared distance along x
+static void addBumpSpan(float *row, int z0, int z1, float dz, float dx2,
+	float inverseRadiusSquared, float halfDisplacement)
+{
+	int z = z0;
+	const float *c = cosPiSqrtTerms;
+#if defined(__AVX__)
+	// Eight points per iteration, same arithmetic as scalar code
+	__m256 offsets = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+	__m256 one = _mm256_set1_ps(1);
+	__m256 x2 = _mm256_set1_ps(dx2);
+	__m256 scale = _mm256_set1_ps(inverseRadiusSquared);
+	__m256 half = _mm256_set1_ps(halfDisplacement);
+	for (; z + 7 <= z1; z += 8, dz += 8)
+	{
+		__m256 d = _mm256_add_ps(_mm256_set1_ps(dz), offsets);
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(x2, _mm256_mul_ps(d, d)), scale);
+		t = _mm256_min_ps(t, one);
+		__m256 sum = _mm256_set1_ps(c[9]);
+		for (int k = 8; k >= 0; k--)
+			sum = _mm256_add_ps(_mm256_mul_ps(sum, t), _mm256_set1_ps(c[k]));
+		__m256 bump = _mm256_mul_ps(half, _mm256_add_ps(one, sum));
+		_mm256_storeu_ps(row + z,
+			_mm256_add_ps(_mm256_loadu_ps(row + z), bump));
+	}
+#elif defined(__SSE2__)
+	// Four points per iteration, same arithmetic as scalar code
+	__m128 offsets = _mm_set_ps(3, 2, 1, 0);
+	__m128 one = _mm_set1_ps(1);
+	__m128 x2 = _mm_set1_ps(dx2);
+	__m128 scale = _mm_set1_ps(inverseRadiusSquared);
+	__m128 half = _mm_set1_ps(halfDisplacement);
+	for (; z + 3 <= z1; z += 4, dz += 4)
+	{
+		__m128 d = _mm_add_ps(_mm_set1_ps(dz), offsets);
+		__m128 t = _mm_mul_ps(_mm_add_ps(x2, _mm_mul_ps(d, d)), scale);
+		t = _mm_min_ps(t, one);
+		__m128 sum = _mm_set1_ps(c[9]);
+		for (int k = 8; k >= 0; k--)
+			sum = _mm_add_ps(_mm_mul_ps(sum, t), _mm_set1_ps(c[k]));
+		__m128 bump = _mm_mul_ps(half, _mm_add_ps(one, sum));
+		_mm_storeu_ps(row + z, _mm_add_ps(_mm_loadu_ps(row + z), bump));
+	}
+#endif
+
+	// Remaining points (or all points without vector instructions)
+	for (; z <= z1; z++, dz++)
+	{
+		float t = (dx2 + dz * dz) * inverseRadiusSquared;
+		t = t < 1 ? t : 1;
+		row[z] += halfDisplacement * (1 + cosPiSqrt(t));
+	}
+}
+
+// Add count values to row
+static void addSpan(float *row, const float *values, int count)
+{
+	int i = 0;
+#if defined(__AVX__)
+	for (; i + 7 < count; i += 8)
+		_mm256_storeu_ps(row + i, _mm256_add_ps(_mm256_loadu_ps(row + i),
+			_mm256_loadu_ps(values + i)));
+#elif defined(__SSE2__)
+	for (; i + 3 < count; i += 4)
+		_mm_storeu_ps(row + i, _mm_add_ps(_mm_loadu_ps(row + i),
+			_mm_loadu_ps(values + i)));
+#endif
+	for (; i < count; i++)
+		row[i] += values[i];
+}
+
+// Bounding square of points affected by circle
+GridRegion TerrainGrid::circleRegion(Circle circle)
+{
+	// Only points within half the circle size from center are affected
+	float radius = circle.size / 2;
+	GridRegion region =
+	{
+		(int)fmax(0, ceil(circle.x - radius)),
+		(int)fmax(0, ceil(circle.z - radius)),
+		(int)fmin(size - 1, floor(circle.x + radius)),
+		(int)fmin(size - 1, floor(circle.z + radius))
+	};
+	return region;
+}
+
+// Height circle adds at point (x, z), cosine bump within radius
+float TerrainGrid::circleHeight(Circle circle, float x, float z)
+{
+	float radius = circle.size / 2;
+	float distance = sqrtf((x - circle.x) * (x - circle.x)
+		+ (z - circle.z) * (z - circle.z));
+	if (distance > radius)
+		return 0;
+	return circle.displacement / 2
+		* (1 + cosf(distance / radius * (float)M_PI));
+}
+
+// Add circle to rows first to last, each row only visits the span of
+// points inside the circle
+void TerrainGrid::addCircleRows(Circle circle, int first, int last)
+{
+	float radius = circle.size / 2;
+	float radiusSquared = radius * radius;
+	float inverseRadiusSquared = 1 / radiusSquared;
+	float halfDisplacement = circle.displacement / 2;
+
+	// Circles centered on grid points are symmetric, so each bump value is
+	// computed once and added to both halves of rows on both sides
+	if (circle.x == floorf(circle.x) && circle.z == floorf(circle.z))
+	{
+		// Profile holds spans up to the radius on each side of center,
+		// rounding in square root kept from going past it
+		int centerX = circle.x, centerZ = circle.z, widest = radius;
+		static thread_local std::vector<float> profile;
+		profile.resize(widest * 2 + 1);
+
+		for (int dx = 0; dx <= radius; dx++)
+		{
+			// Skip offsets with neither row inside band
+			int below = centerX - dx, above = centerX + dx;
+			int useBelow = below >= first && below <= last;
+			int useAbove = dx > 0 && above >= first && above <= last;
+			if (!useBelow && !useAbove)
+				continue;
+
+			// Half of span computed, then mirrored around center
+			int halfSpan = sqrtf(radiusSquared - dx * dx);
+			halfSpan = halfSpan < widest ? halfSpan : widest;
+			float *middle = &profile[halfSpan];
+			for (int j = 0; j <= halfSpan; j++)
+				middle[j] = 0;
+			addBumpSpan(middle, 0, halfSpan, 0, dx * dx,
+				inverseRadiusSquared, halfDisplacement);
+			for (int j = 1; j <= halfSpan; j++)
+				middle[-j] = middle[j];
+
+			// Span clipped to grid
+			int minZ = centerZ - halfSpan > 0 ? centerZ - halfSpan : 0;
+			int maxZ = centerZ + halfSpan < size - 1
+				? centerZ + halfSpan : size - 1;
+			const float *values = middle + (minZ - centerZ);
+			if (useBelow)
+				addSpan(&heights[index(below, minZ)], values, maxZ - minZ + 1);
+			if (useAbove)
+				addSpan(&heights[index(above, minZ)], values, maxZ - minZ + 1);
+		}
+		return;
+	}
+
+	for (int x = first; x <= last; x++)
+	{
+		// Span of row within circle, skip rows that miss it
+		float dx = x - circle.x;
+		float remaining = radiusSquared - dx * dx;
+		if (remaining < 0)
+			continue;
+		float halfSpan = sqrtf(remaining);
+		int minZ = (int)fmax(0, ceil(circle.z - halfSpan));
+		int maxZ = (int)fmin(size - 1, floor(circle.z + halfSpan));
+
+		// Adjust height using cosine function of normalized distance
+		addBumpSpan(&heights[index(x, 0)], minZ, maxZ, minZ - circle.z,
+			dx * dx, inverseRadiusSquared, halfDisplacement);
+	}
+}
+
+// Add circle in circles algorithm, returns region of points whose heights
+// may have changed
+GridRegion TerrainGrid::addCircle(float circleX, float circleZ,
+	float circleSize, float circleDisplacement)
+{
+	Circle circle = { circleX, circleZ, circleSize, circleDisplacement };
+	GridRegion region = circleRegion(circle);
+
+	// Greatest heights within region before and after adjustment
+	float oldGreatest = greatestHeightInRows(region.minX, region.maxX,
+		region.minZ, region.maxZ);
+	addCircleRows(circle, region.minX, region.maxX);
+	float newGreatest = greatestHeightInRows(region.minX, region.maxX,
+		region.minZ, region.maxZ);
+
+	// Rescan whole grid only if previous greatest height was lowered
+	if (circleDisplacement < 0 && oldGreatest >= greatestHeight)
+		findGreatestHeight();
+	else if (newGreatest > greatestHeight)
+		greatestHeight = newGreatest;
+
+	return region;
+}
+
+// Queue circle into newest cluster it overlaps whose region stays compact,
+// otherwise start a new cluster (circles missing the grid are dropped)
+void TerrainGrid::clusterCircle(std::vector<CircleCluster> &clusters,
+	Circle circle)
+{
+	GridRegion region = circleRegion(circle);
+	if (region.minX > region.maxX || region.minZ > region.maxZ)
+		return;
+	float limit = circle.size * 2;
+	for (size_t i = clusters.size(); i-- > 0;)
+	{
+		GridRegion &joined = clusters[i].region;
+		if (region.minX > joined.maxX || region.maxX < joined.minX
+			|| region.minZ > joined.maxZ || region.maxZ < joined.minZ)
+			continue;
+		GridRegion merged =
+		{
+			region.minX < joined.minX ? region.minX : joined.minX,
+			region.minZ < joined.minZ ? region.minZ : joined.minZ,
+			region.maxX > joined.maxX ? region.maxX : joined.maxX,
+			region.maxZ > joined.maxZ ? region.maxZ : joined.maxZ
+		};
+		if (merged.maxX - merged.minX + 1 > limit
+			|| merged.maxZ - merged.minZ + 1 > limit)
+			continue;
+		joined = merged;
+		clusters[i].circles.push_back(circle);
+		return;
+	}
+	CircleCluster cluster;
+	cluster.region = region;
+	cluster.circles.push_back(circle);
+	clusters.push_back(cluster);
+}
+
+// Add batch of circles in order, rows of their combined region split
+// across threads, returns region of points whose heights may have changed
+GridRegion TerrainGrid::addCircles(const std::vector<Circle> &circles,
+	ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+
+	// Combined region of all circles, and whether any pushes downward
+	std::vector<GridRegion> regions(circles.size());
+	GridRegion region = { 0, 0, -1, -1 };
+	int lowers = 0;
+	for (size_t i = 0; i < circles.size(); i++)
+	{
+		regions[i] = circleRegion(circles[i]);
+		lowers |= circles[i].displacement < 0;
+		if (i == 0)
+			region = regions[i];
+		region.minX = regions[i].minX < region.minX ? regions[i].minX
+			: region.minX;
+		region.minZ = regions[i].minZ < region.minZ ? regions[i].minZ
+			: region.minZ;
+		region.maxX = regions[i].maxX > region.maxX ? regions[i].maxX
+			: region.maxX;
+		region.maxZ = regions[i].maxZ > region.maxZ ? regions[i].maxZ
+			: region.maxZ;
+	}
+	if (circles.empty())
+		return region;
+
+	// Each band adds part of every circle overlapping it, in batch order,
+	// tracking greatest heights of band before and after
+	std::mutex mutex;
+	float oldGreatest = 0, newGreatest = 0;
+	pool->forRows(region.maxX - region.minX + 1, [&](int first, int last)
+	{
+		first += region.minX;
+		last += region.minX;
+		float before = greatestHeightInRows(first, last,
+			region.minZ, region.maxZ);
+		for (size_t i = 0; i < circles.size(); i++)
+		{
+			int minX = regions[i].minX > first ? regions[i].minX : first;
+			int maxX = regions[i].maxX < last ? regions[i].maxX : last;
+			if (minX <= maxX)
+				addCircleRows(circles[i], minX, maxX);
+		}
+		float after = greatestHeightInRows(first, last,
+			region.minZ, region.maxZ);
+		std::lock_guard<std::mutex> lock(mutex);
+		oldGreatest = fmaxf(oldGreatest, before);
+		newGreatest = fmaxf(newGreatest, after);
+	});
+
+	// Rescan whole grid only if previous greatest height may be lowered
+	if (lowers && oldGreatest >= greatestHeight)
+		findGreatestHeight();
+	else if (newGreatest > greatestHeight)
+		greatestHeight = newGreatest;
+
+	return region;
+}
+
+// Circle i of circles algorithm, derived only from seed and i
+Circle TerrainGrid::seededCircle(uint64_t seed, int i)
+{
+	Circle circle;
+	circle.x = randomInt(seed, (uint64_t)i * 3, size);
+	circle.z = randomInt(seed, (uint64_t)i * 3 + 1, size);
+	circle.size = randomInt(seed, (uint64_t)i * 3 + 2, size) / 2 + 5;
+	circle.displacement = circle.size / size * 5;
+	return circle;
+}
+
+// Generate new terrain using circles algorithm, rows split into bands
+// across threads with every band applying circles in the same order, so
+// the result depends only on seed and not on number of threads
+void TerrainGrid::generateCircles(uint64_t seed, ThreadPool *pool)
+{
+	this->seed = seed;
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+
+	// Circle dimensions/placement up front
+	std::vector<Circle> circles(size);
+	std::vector<GridRegion> regions(size);
+	for (int i = 0; i < size; i++)
+	{
+		circles[i] = seededCircle(seed, i);
+		regions[i] = circleRegion(circles[i]);
+	}
+
+	// Clear band, then add part of every circle overlapping band
+	pool->forRows(size, [&](int first, int last)
+	{
+		for (int x = first; x <= last; x++)
+			for (int z = 0; z < size; z++)
+				height(x, z) = 0;
+
+		for (int i = 0; i < size; i++)
+		{
+			int minX = regions[i].minX > first ? regions[i].minX : first;
+			int maxX = regions[i].maxX < last ? regions[i].maxX : last;
+			if (minX <= maxX)
+				addCircleRows(circles[i], minX, maxX);
+		}
+	});
+
+	// Separate pass for greatest height keeps hot loop free of branches
+	findGreatestHeight();
+}
+
+// FNV-1a hash of height map bits, identical maps give identical hashes
+uint64_t TerrainGrid::hash()
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const unsigned char *bytes = (const unsigned char*)heights;
+	for (size_t i = 0; i < (size_t)size * size * sizeof(float); i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+}
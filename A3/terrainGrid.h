@@ -0,0 +1,173 @@
+#ifndef TERRAINGRID_H
+#define TERRAINGRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class ThreadPool;
+
+// Rectangular region of grid points (inclusive bounds, empty if min > max)
+struct GridRegion
+{
+	int minX, minZ, maxX, maxZ;
+};
+
+// Add region to list of disjoint regions, keeping only the parts of it
+// not already listed (regions it covers are replaced)
+void addDisjointRegion(std::vector<GridRegion> &regions, GridRegion region);
+
+// Circle in circles algorithm, center and size in grid units
+struct Circle
+{
+	float x, z, size, displacement;
+};
+
+// Overlapping circles of a batch, applied together over their combined
+// region
+struct CircleCluster
+{
+	GridRegion region;
+	std::vector<Circle> circles;
+};
+
+// Normal map stored as separate x, y and z component planes
+struct NormalMap
+{
+	float *nx, *ny, *nz;
+
+	// Copy normal at index into 3 float array
+	void get(size_t i, float *normal)
+		{ normal[0] = nx[i]; normal[1] = ny[i]; normal[2] = nz[i]; }
+};
+
+// Square terrain grid, heights, normal components and colors stored
+// row-major (x by z) in one cache-aligned allocation sized to the grid
+class TerrainGrid
+{
+public:
+	// Number of points per side, and existing height map to use instead
+	// of allocating one (not freed with grid)
+	TerrainGrid(int size, float *heights = NULL);
+	~TerrainGrid(); // Destructor
+
+	int size;
+	uint64_t seed;
+	float greatestHeight;
+
+	// Height map and normal maps for squares, triangles pointing to x and
+	// z axes, and vertices (squares share corners with triangles pointing
+	// to z axis, so both use the same planes)
+	float *heights;
+	NormalMap squareNormals;
+	NormalMap triangleXNormals;
+	NormalMap triangleZNormals;
+	NormalMap vertexNormals;
+
+	// Color of each point as RGBA bytes, shared by every view of terrain
+	uint32_t *colors;
+
+	// Accessors for point (x, z), normals copied into 3 float array
+	size_t index(int x, int z)
+		{ return (size_t)x * size + z; }
+	float &height(int x, int z)
+		{ return heights[index(x, z)]; }
+	void squareNormal(int x, int z, float *normal)
+		{ squareNormals.get(index(x, z), normal); }
+	void triangleXNormal(int x, int z, float *normal)
+		{ triangleXNormals.get(index(x, z), normal); }
+	void triangleZNormal(int x, int z, float *normal)
+		{ triangleZNormals.get(index(x, z), normal); }
+	void vertexNormal(int x, int z, float *normal)
+		{ vertexNormals.get(index(x, z), normal); }
+	const unsigned char *color(int x, int z)
+		{ return (const unsigned char*)&colors[index(x, z)]; }
+
+	// Total bytes allocated for heights, normals and colors
+	size_t bytes();
+
+	// Recompute face normals (and vertex normals if smooth) affected by
+	// height changes in region, vertex normals depend on polygon type
+	void computeNormals(GridRegion region, int triangles, int smooth);
+
+	// Recompute vertex normals of points in region from face normals,
+	// interior rows split across threads (shared pool if NULL) with
+	// branch-free sums, points on grid edges in a separate pass
+	void computeVertexNormals(GridRegion vertices, int triangles,
+		ThreadPool *pool = NULL);
+
+	// Recompute face normals of cells in region a row at a time, using
+	// SSE/AVX when available unless simd is 0
+	void computeFaceNormals(GridRegion cells, int simd);
+
+	// Recompute colors of points in region as gradient from low to high
+	// color by height relative to greatest height, rows split across
+	// threads, using SSE/AVX when available unless simd is 0
+	void computeColors(GridRegion region, const float *lowColor,
+		const float *highColor, int simd);
+
+	// Rescan every point for greatest height
+	void findGreatestHeight();
+
+	// Add circle in circles algorithm, returns region of changed points
+	GridRegion addCircle(float circleX, float circleZ,
+		float circleSize, float circleDisplacement);
+
+	// Add batch of circles in order, rows of their combined region split
+	// across threads (shared pool if NULL), returns region of changed
+	// points
+	GridRegion addCircles(const std::vector<Circle> &circles,
+		ThreadPool *pool = NULL);
+
+	// Queue circle into newest cluster whose region it overlaps, unless
+	// that would stretch the cluster past twice the circle size on a side,
+	// so clusters of a stroke stay compact instead of spanning the grid
+	void clusterCircle(std::vector<CircleCluster> &clusters, Circle circle);
+
+	// Generate new terrain using circles algorithm from seed, in parallel
+	// on given pool (shared pool if NULL)
+	void generateCircles(uint64_t seed, ThreadPool *pool = NULL);
+
+	// Circle i of circles algorithm for seed
+	Circle seededCircle(uint64_t seed, int i);
+
+	// Hash of height map for comparing terrains
+	uint64_t hash();
+
+	// Bounding square of points affected by circle
+	GridRegion circleRegion(Circle circle);
+
+	// Height circle adds at point (x, z), 0 outside circle
+	float circleHeight(Circle circle, float x, float z);
+
+private:
+	void *block;
+	size_t blockSize;
+
+	// Face normals for cells z0 to z1 of row x, scalar or vectorized
+	void faceNormalRowScalar(int x, int z0, int z1);
+	void faceNormalRowSimd(int x, int z0, int z1);
+
+	// Colors of points z0 to z1 of row x from color at height 0, change of
+	// color per unit height (both scaled to bytes), scalar or vectorized
+	void colorRowScalar(int x, int z0, int z1, const float *base,
+		const float *slope);
+	void colorRowSimd(int x, int z0, int z1, const float *base,
+		const float *slope);
+
+	// Vertex normals for interior points z0 to z1 of interior row x, and
+	// for point (x, z) on edge of grid
+	void vertexNormalRow(int x, int z0, int z1, int triangles);
+	void edgeVertexNormal(int x, int z, int triangles);
+
+	// Add face normal at cell (x, z) to accumulated vertex normal
+	void addFaceNormal(NormalMap &map, int x, int z, float *normal);
+
+	// Add circle to rows first to last only
+	void addCircleRows(Circle circle, int first, int last);
+
+	// Greatest height within rows first to last between columns
+	float greatestHeightInRows(int first, int last, int minZ, int maxZ);
+};
+
+#endif
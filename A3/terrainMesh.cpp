@@ -0,0 +1,299 @@
+// Standard C++ library imports
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// Local imports
+#include "terrainMesh.h"
+#include "threadPool.h"
+
+// Constructor: no chunk meshes until chunks are drawn
+TerrainMesh::TerrainMesh(TerrainChunks *chunks, float origin, size_t budget)
+{
+	this->chunks = chunks;
+	this->origin = origin;
+	this->budget = budget;
+	smooth = 0;
+	triangles = 0;
+	bytes = 0;
+	verticesBuilt = 0;
+	uncachedBuilds = 0;
+	frame = 0;
+	meshes.resize(chunks->count);
+	for (int i = 0; i < chunks->count; i++)
+	{
+		meshes[i].level = 0;
+		meshes[i].stale = 1;
+		meshes[i].lastDrawn = 0;
+	}
+	scratch.resize(scratchChunks);
+	scratchFirst = 0;
+	scratchCount = 0;
+}
+
+// Mark meshes of chunks with vertices depending on points in region as
+// stale
+void TerrainMesh::invalidate(GridRegion region)
+{
+	// Normals of vertices use heights up to two points away, and points on
+	// a chunk border belong to chunks on both sides
+	int firstRow = (fmax(region.minX - 2, 1) - 1) / chunks->chunkSize;
+	int lastRow = fmin((region.maxX + 2) / chunks->chunkSize,
+		chunks->perSide - 1);
+	int firstColumn = (fmax(region.minZ - 2, 1) - 1) / chunks->chunkSize;
+	int lastColumn = fmin((region.maxZ + 2) / chunks->chunkSize,
+		chunks->perSide - 1);
+	for (int i = firstRow; i <= lastRow; i++)
+		for (int j = firstColumn; j <= lastColumn; j++)
+			meshes[i * chunks->perSide + j].stale = 1;
+}
+
+// Rebuild stale meshes of visible chunks in parallel, evicting least
+// recently drawn meshes to stay within budget
+void TerrainMesh::update(TerrainGrid &grid)
+{
+	// Cached meshes of visible chunks stay, other visible chunks are
+	// cached while budget allows
+	frame++;
+	size_t reserved = 0;
+	for (int k = 0; k < chunks->visibleCount; k++)
+	{
+		int index = chunks->visible[k];
+		meshes[index].lastDrawn = frame;
+		if (cached(index))
+			reserved += meshBytes(meshes[index]);
+	}
+	builds.clear();
+	uncached.clear();
+	scratchCount = 0;
+	for (int k = 0; k < chunks->visibleCount; k++)
+	{
+		int index = chunks->visible[k];
+		if (cached(index))
+			continue;
+		size_t estimate = estimateBytes(index);
+		if (reserved + estimate > budget)
+		{
+			release(index);
+			uncached.push_back(index);
+			continue;
+		}
+		builds.push_back(index);
+		reserved += estimate;
+	}
+	trim(budget > reserved ? budget - reserved : 0);
+
+	// Chunks are independent, so each builds on its own task
+	for (size_t k = 0; k < builds.size(); k++)
+		bytes -= meshBytes(meshes[builds[k]]);
+	ThreadPool::shared().run(builds.size(), [&](int task)
+	{
+		build(grid, builds[task], meshes[builds[task]]);
+	});
+	for (size_t k = 0; k < builds.size(); k++)
+	{
+		bytes += meshBytes(meshes[builds[k]]);
+		verticesBuilt += meshes[builds[k]].vertices.size();
+	}
+}
+
+// Mesh of chunk at its selected level, chunks not cached are built into
+// scratch space together with the following ones
+ChunkMesh &TerrainMesh::chunkMesh(TerrainGrid &grid, int index)
+{
+	if (cached(index))
+		return meshes[index];
+
+	// Uncached chunks keep visible order, which is ascending
+	size_t k = std::lower_bound(uncached.begin(), uncached.end(), index)
+		- uncached.begin();
+	if (k >= uncached.size() || uncached[k] != index)
+	{
+		// Chunk not seen by last update
+		build(grid, index, scratch[0]);
+		verticesBuilt += scratch[0].vertices.size();
+		uncachedBuilds++;
+		scratchCount = 0;
+		return scratch[0];
+	}
+
+	// Refill scratch space from this chunk onwards in parallel
+	if (k < scratchFirst || k >= scratchFirst + scratchCount)
+	{
+		scratchFirst = k;
+		scratchCount = std::min(uncached.size() - k, scratch.size());
+		ThreadPool::shared().run(scratchCount, [&](int task)
+		{
+			build(grid, uncached[k + task], scratch[task]);
+		});
+		for (size_t j = 0; j < scratchCount; j++)
+			verticesBuilt += scratch[j].vertices.size();
+		uncachedBuilds += scratchCount;
+	}
+	return scratch[k - scratchFirst];
+}
+
+// Bytes needed to cache every chunk at full detail
+size_t TerrainMesh::fullDetailBytes()
+{
+	return (size_t)(chunks->gridSize - 1) * chunks->gridSize * 2
+		* sizeof(MeshVertex);
+}
+
+// Check whether cached mesh of chunk matches its selected level and edge
+// splits
+int TerrainMesh::cached(int index)
+{
+	ChunkMesh &mesh = meshes[index];
+	TerrainChunk &chunk = chunks->chunks[index];
+	if (mesh.stale || mesh.vertices.empty() || mesh.level != chunk.level)
+		return 0;
+	if (chunk.level == 0)
+		return 1;
+	int splits[4];
+	chunks->levelSplits(index, splits);
+	return memcmp(splits, mesh.splits, sizeof(splits)) == 0;
+}
+
+// Rough upper bound of bytes needed by mesh of chunk at its selected level
+size_t TerrainMesh::estimateBytes(int index)
+{
+	TerrainChunk &chunk = chunks->chunks[index];
+	size_t rows = chunk.maxX - chunk.minX + 1;
+	size_t columns = chunk.maxZ - chunk.minZ + 1;
+	if (chunk.level == 0)
+		return rows * (columns + 1) * 2 * sizeof(MeshVertex);
+
+	// Corners of cells at chunk step, plus split points and fan centers
+	// along edges, each adding about one triangle
+	size_t step = 1 << chunk.level;
+	size_t cellRows = (rows + step - 1) / step;
+	size_t cellColumns = (columns + step - 1) / step;
+	size_t edge = (rows + columns) * 2;
+	size_t points = (cellRows + 1) * (cellColumns + 1) + edge;
+	size_t faces = cellRows * cellColumns * 2 + edge;
+	return points * sizeof(MeshVertex) + faces * 3 * sizeof(unsigned int);
+}
+
+// Bytes held by mesh
+size_t TerrainMesh::meshBytes(ChunkMesh &mesh)
+{
+	return mesh.vertices.capacity() * sizeof(MeshVertex)
+		+ mesh.indices.capacity() * sizeof(unsigned int);
+}
+
+// Free mesh of chunk
+void TerrainMesh::release(int index)
+{
+	ChunkMesh &mesh = meshes[index];
+	bytes -= meshBytes(mesh);
+	std::vector<MeshVertex>().swap(mesh.vertices);
+	std::vector<unsigned int>().swap(mesh.indices);
+	mesh.stale = 1;
+}
+
+// Free meshes not drawn this frame, least recently drawn first, until
+// they hold at most limit bytes
+void TerrainMesh::trim(size_t limit)
+{
+	// Meshes held by chunks outside view
+	std::vector<int> others;
+	size_t otherBytes = 0;
+	for (int i = 0; i < chunks->count; i++)
+	{
+		if (meshes[i].lastDrawn == frame || meshes[i].vertices.empty())
+			continue;
+		others.push_back(i);
+		otherBytes += meshBytes(meshes[i]);
+	}
+	if (otherBytes <= limit)
+		return;
+
+	std::sort(others.begin(), others.end(), [&](int a, int b)
+	{
+		return meshes[a].lastDrawn < meshes[b].lastDrawn;
+	});
+	for (size_t k = 0; k < others.size() && otherBytes > limit; k++)
+	{
+		otherBytes -= meshBytes(meshes[others[k]]);
+		release(others[k]);
+	}
+}
+
+// Build mesh of chunk at its selected level
+void TerrainMesh::build(TerrainGrid &grid, int index, ChunkMesh &mesh)
+{
+	TerrainChunk &chunk = chunks->chunks[index];
+	mesh.level = chunk.level;
+	mesh.stale = 0;
+	mesh.indices.clear();
+
+	// Full detail chunk is one strip per row of cells, vertex on next row
+	// followed by vertex on current row
+	if (chunk.level == 0)
+	{
+		int columns = chunk.maxZ - chunk.minZ + 2;
+		mesh.vertices.resize((size_t)(chunk.maxX - chunk.minX + 1)
+			* columns * 2);
+		MeshVertex *vertex = mesh.vertices.data();
+		for (int x = chunk.minX; x <= chunk.maxX; x++)
+		{
+			for (int z = chunk.minZ; z <= chunk.maxZ + 1; z++)
+			{
+				buildVertex(grid, x, x + 1, z, *vertex++);
+				buildVertex(grid, x, x, z, *vertex++);
+			}
+		}
+		return;
+	}
+
+	// Coarser chunk uses grid points of its triangles, as drawn in strip
+	// of the row they start except on last row
+	chunks->levelSplits(index, mesh.splits);
+	chunks->appendLevelTriangles(index, mesh.indices);
+	static thread_local std::vector<unsigned int> points;
+	points.assign(mesh.indices.begin(), mesh.indices.end());
+	std::sort(points.begin(), points.end());
+	points.erase(std::unique(points.begin(), points.end()), points.end());
+	mesh.vertices.resize(points.size());
+	int size = chunks->gridSize;
+	for (size_t k = 0; k < points.size(); k++)
+	{
+		int x = points[k] / size, z = points[k] % size;
+		buildVertex(grid, x < size - 1 ? x : x - 1, x, z, mesh.vertices[k]);
+	}
+
+	// Indices into chunk's own points
+	for (size_t k = 0; k < mesh.indices.size(); k++)
+		mesh.indices[k] = std::lower_bound(points.begin(), points.end(),
+			mesh.indices[k]) - points.begin();
+}
+
+// Fill vertex at point (x, z) as drawn in strip of cell row
+void TerrainMesh::buildVertex(TerrainGrid &grid, int strip, int x, int z,
+	MeshVertex &vertex)
+{
+	vertex.position[0] = origin + x;
+	vertex.position[1] = grid.height(x, z);
+	vertex.position[2] = origin + z;
+	memcpy(vertex.color, grid.color(x, z), sizeof(vertex.color));
+
+	// Smooth normals shared between all adjacent faces
+	if (smooth)
+	{
+		grid.vertexNormal(x, z, vertex.normal);
+		return;
+	}
+
+	// Flat normals go on the last vertex of each polygon in strip, no
+	// polygon ends on first column of grid
+	vertex.normal[0] = 0;
+	vertex.normal[1] = 1;
+	vertex.normal[2] = 0;
+	if (z >= 1 && triangles && x == strip)
+		grid.triangleZNormal(strip, z - 1, vertex.normal);
+	if (z >= 1 && triangles && x != strip)
+		grid.triangleXNormal(strip, z - 1, vertex.normal);
+	if (z >= 1 && !triangles && x == strip)
+		grid.squareNormal(strip, z - 1, vertex.normal);
+}
@@ -0,0 +1,114 @@
+#ifndef TERRAINMESH_H
+#define TERRAINMESH_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "terrainChunks.h"
+#include "terrainGrid.h"
+
+// Default memory budget of cached chunk meshes (bytes)
+static const size_t defaultMeshBudget = (size_t)256 << 20;
+
+// Chunks beyond budget built together in parallel as they are drawn
+static const int scratchChunks = 64;
+
+// Interleaved vertex with position, normal and RGBA color for terrain
+// mesh
+struct MeshVertex
+{
+	float position[3];
+	float normal[3];
+	unsigned char color[4];
+};
+
+// Vertices of one chunk built for its level and edge splits. Full detail
+// chunks hold one strip per row of cells with two vertices per column,
+// alternating between next row and current row, coarser chunks hold the
+// grid points used by their triangles and indices into them
+struct ChunkMesh
+{
+	int level;
+	int splits[4];
+	int stale;
+	unsigned long lastDrawn;
+	std::vector<MeshVertex> vertices;
+	std::vector<unsigned int> indices;
+};
+
+// Chunk meshes built only for visible chunks at their selected level and
+// cached within a memory budget, least recently drawn chunks are evicted
+// first and chunks beyond budget are rebuilt each time they are drawn
+class TerrainMesh
+{
+public:
+	// Chunks to build meshes for, world position of point (0, 0) and
+	// budget in bytes of cached meshes
+	TerrainMesh(TerrainChunks *chunks, float origin, size_t budget);
+
+	// Normals of built vertices: smooth vertex normals, or flat normals
+	// of triangles or squares
+	int smooth, triangles;
+
+	// Budget and bytes held by cached meshes
+	size_t budget, bytes;
+
+	// Statistics: vertices built and meshes built without room in cache
+	long verticesBuilt, uncachedBuilds;
+
+	// Mark meshes of chunks with vertices depending on points in region
+	// as stale
+	void invalidate(GridRegion region);
+
+	// Rebuild stale meshes of visible chunks in parallel, evicting least
+	// recently drawn meshes to stay within budget
+	void update(TerrainGrid &grid);
+
+	// Mesh of chunk at its selected level, visible chunks are asked for in
+	// order, chunks not cached are built into scratch space together with
+	// the following ones (valid until scratch space is refilled)
+	ChunkMesh &chunkMesh(TerrainGrid &grid, int index);
+
+	// Bytes needed to cache every chunk at full detail
+	size_t fullDetailBytes();
+
+private:
+	TerrainChunks *chunks;
+	float origin;
+	std::vector<ChunkMesh> meshes;
+	unsigned long frame;
+
+	// Chunks rebuilt by last update, and visible chunks left out of cache
+	std::vector<int> builds, uncached;
+
+	// Meshes of uncached chunks from first scratch chunk onwards
+	std::vector<ChunkMesh> scratch;
+	size_t scratchFirst, scratchCount;
+
+	// Check whether cached mesh of chunk matches its selected level and
+	// edge splits
+	int cached(int index);
+
+	// Rough upper bound of bytes needed by mesh of chunk at its selected
+	// level
+	size_t estimateBytes(int index);
+
+	// Bytes held by mesh
+	static size_t meshBytes(ChunkMesh &mesh);
+
+	// Free mesh of chunk
+	void release(int index);
+
+	// Free meshes not drawn this frame, least recently drawn first, until
+	// they hold at most limit bytes
+	void trim(size_t limit);
+
+	// Build mesh of chunk at its selected level
+	void build(TerrainGrid &grid, int index, ChunkMesh &mesh);
+
+	// Fill vertex at point (x, z) as drawn in strip of cell row
+	void buildVertex(TerrainGrid &grid, int strip, int x, int z,
+		MeshVertex &vertex);
+};
+
+#endif
@@ -0,0 +1,255 @@
+// Standard C++ library imports
+#include <math.h>
+#include <algorithm>
+
+// Local imports
+#include "terrainPicker.h"
+#include "threadPool.h"
+
+// Constructor: size levels from blocks of leaf cells up to a single node,
+// bounds are filled by first update
+TerrainPicker::TerrainPicker(int gridSize)
+{
+	this->gridSize = gridSize;
+	nodesVisited = trianglesTested = 0;
+	int nodes = (gridSize - 1 + pickLeafCells - 1) / pickLeafCells;
+	while (1)
+	{
+		perSide.push_back(nodes);
+		bounds.push_back(std::vector<float>((size_t)nodes * nodes * 2, 0));
+		if (nodes == 1)
+			break;
+		nodes = (nodes + 1) / 2;
+	}
+	levels = perSide.size();
+}
+
+// Recompute height bounds of nodes containing points in region, rows of
+// level 0 nodes split across threads
+void TerrainPicker::update(TerrainGrid &grid, GridRegion region,
+	ThreadPool *pool)
+{
+	if (pool == NULL)
+		pool = &ThreadPool::shared();
+
+	// Cells touching changed points, and level 0 nodes containing them
+	int cells = gridSize - 1;
+	int minI = std::max(region.minX - 1, 0) / pickLeafCells;
+	int maxI = std::min(region.maxX, cells - 1) / pickLeafCells;
+	int minJ = std::max(region.minZ - 1, 0) / pickLeafCells;
+	int maxJ = std::min(region.maxZ, cells - 1) / pickLeafCells;
+	if (minI > maxI || minJ > maxJ)
+		return;
+
+	// Level 0 from every point of its cells, shared edges included
+	pool->forRows(maxI - minI + 1, [&](int first, int last)
+	{
+		for (int i = minI + first; i <= minI + last; i++)
+			for (int j = minJ; j <= maxJ; j++)
+			{
+				int x0 = i * pickLeafCells, z0 = j * pickLeafCells;
+				int x1 = std::min(x0 + pickLeafCells, cells);
+				int z1 = std::min(z0 + pickLeafCells, cells);
+				float low = grid.height(x0, z0), high = low;
+				for (int x = x0; x <= x1; x++)
+					for (int z = z0; z <= z1; z++)
+					{
+						low = std::min(low, grid.height(x, z));
+						high = std::max(high, grid.height(x, z));
+					}
+				float *node = &bounds[0][((size_t)i * perSide[0] + j) * 2];
+				node[0] = low;
+				node[1] = high;
+			}
+	});
+
+	// Each level above from the 2 x 2 nodes below it
+	for (int level = 1; level < levels; level++)
+	{
+		minI /= 2;
+		maxI /= 2;
+		minJ /= 2;
+		maxJ /= 2;
+		int below = perSide[level - 1];
+		for (int i = minI; i <= maxI; i++)
+			for (int j = minJ; j <= maxJ; j++)
+			{
+				float low = INFINITY, high = -INFINITY;
+				for (int k = 0; k < 4; k++)
+				{
+					int ci = i * 2 + k / 2, cj = j * 2 + k % 2;
+					if (ci >= below || cj >= below)
+						continue;
+					const float *child =
+						&bounds[level - 1][((size_t)ci * below + cj) * 2];
+					low = std::min(low, child[0]);
+					high = std::max(high, child[1]);
+				}
+				float *node =
+					&bounds[level][((size_t)i * perSide[level] + j) * 2];
+				node[0] = low;
+				node[1] = high;
+			}
+	}
+}
+
+// Distances along ray where it enters and leaves box of node, from slabs
+// of box along each axis, returns 0 if ray misses box
+int TerrainPicker::enterNode(int level, int i, int j, const float *origin,
+	const float *inverse, float &enter, float &leave)
+{
+	int cells = gridSize - 1, cellsPerNode = span(level);
+	const float *node = &bounds[level][((size_t)i * perSide[level] + j) * 2];
+	float min[3] = { (float)i * cellsPerNode, node[0],
+		(float)j * cellsPerNode };
+	float max[3] = { (float)std::min((i + 1) * cellsPerNode, cells), node[1],
+		(float)std::min((j + 1) * cellsPerNode, cells) };
+	enter = 0;
+	leave = INFINITY;
+	for (int k = 0; k < 3; k++)
+	{
+		float t0 = (min[k] - origin[k]) * inverse[k];
+		float t1 = (max[k] - origin[k]) * inverse[k];
+		enter = fmax(enter, fmin(t0, t1));
+		leave = fmin(leave, fmax(t0, t1));
+	}
+	return enter <= leave;
+}
+
+// Cross product a x b into result
+static inline void cross(const float *a, const float *b, float *result)
+{
+	result[0] = a[1] * b[2] - a[2] * b[1];
+	result[1] = a[2] * b[0] - a[0] * b[2];
+	result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Dot product of a and b
+static inline float dot(const float *a, const float *b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Distance along ray to triangle a, b, c (Moller-Trumbore), or limit if
+// ray misses it or hits it beyond limit, edges count as hits so rays never
+// slip between neighboring triangles
+static float triangleHit(const float *a, const float *b, const float *c,
+	const float *origin, const float *direction, float limit)
+{
+	float edge1[3], edge2[3], p[3], s[3], q[3];
+	for (int k = 0; k < 3; k++)
+	{
+		edge1[k] = b[k] - a[k];
+		edge2[k] = c[k] - a[k];
+		s[k] = origin[k] - a[k];
+	}
+
+	// Ray parallel to triangle never hits it
+	cross(direction, edge2, p);
+	float determinant = dot(edge1, p);
+	if (determinant == 0)
+		return limit;
+
+	// Barycentric coordinates of hit, then distance along ray
+	float inverse = 1 / determinant;
+	float u = dot(s, p) * inverse;
+	if (u < 0 || u > 1)
+		return limit;
+	cross(s, edge1, q);
+	float v = dot(direction, q) * inverse;
+	if (v < 0 || u + v > 1)
+		return limit;
+	float t = dot(edge2, q) * inverse;
+	return t >= 0 && t < limit ? t : limit;
+}
+
+// Distance to nearest hit on triangles of cells in level 0 node, each
+// cell split along its (x, z) to (x + 1, z + 1) diagonal as drawn
+float TerrainPicker::castLeaf(TerrainGrid &grid, int i, int j,
+	const float *origin, const float *direction, float limit)
+{
+	int cells = gridSize - 1;
+	int x0 = i * pickLeafCells, z0 = j * pickLeafCells;
+	int x1 = std::min(x0 + pickLeafCells, cells);
+	int z1 = std::min(z0 + pickLeafCells, cells);
+	for (int x = x0; x < x1; x++)
+		for (int z = z0; z < z1; z++)
+		{
+			float a[3] = { (float)x, grid.height(x, z), (float)z };
+			float b[3] = { x + 1.0f, grid.height(x + 1, z + 1), z + 1.0f };
+			float c[3] = { x + 1.0f, grid.height(x + 1, z), (float)z };
+			float d[3] = { (float)x, grid.height(x, z + 1), z + 1.0f };
+			limit = triangleHit(a, b, c, origin, direction, limit);
+			limit = triangleHit(a, d, b, origin, direction, limit);
+		}
+	trianglesTested += (x1 - x0) * (z1 - z0) * 2;
+	return limit;
+}
+
+// Node still to visit and distance where ray enters it
+struct PickEntry
+{
+	int level, i, j;
+	float enter;
+};
+
+// Nearest hit of ray, visiting nodes front to back from a stack: children
+// a ray enters are pushed farthest first, and nodes entered beyond the
+// nearest hit so far are skipped, so only nodes around the ray's path down
+// to the terrain are visited
+int TerrainPicker::cast(TerrainGrid &grid, const float *origin,
+	const float *direction, float *hit)
+{
+	nodesVisited = trianglesTested = 0;
+	float inverse[3];
+	for (int k = 0; k < 3; k++)
+		inverse[k] = 1 / direction[k];
+
+	// Each visit replaces a node by at most 4 children, one level down
+	PickEntry stack[3 * 32 + 1];
+	int top = 0;
+	float enter, leave, nearest = INFINITY;
+	if (enterNode(levels - 1, 0, 0, origin, inverse, enter, leave))
+	{
+		PickEntry root = { levels - 1, 0, 0, enter };
+		stack[top++] = root;
+	}
+	while (top > 0)
+	{
+		PickEntry node = stack[--top];
+		if (node.enter >= nearest)
+			continue;
+		nodesVisited++;
+		if (node.level == 0)
+		{
+			nearest = castLeaf(grid, node.i, node.j, origin, direction,
+				nearest);
+			continue;
+		}
+
+		// Children entered by ray, sorted by distance farthest first
+		PickEntry children[4];
+		int count = 0, below = perSide[node.level - 1];
+		for (int k = 0; k < 4; k++)
+		{
+			int i = node.i * 2 + k / 2, j = node.j * 2 + k % 2;
+			if (i >= below || j >= below
+				|| !enterNode(node.level - 1, i, j, origin, inverse, enter,
+					leave))
+				continue;
+			PickEntry child = { node.level - 1, i, j, enter };
+			int c = count++;
+			for (; c > 0 && children[c - 1].enter < enter; c--)
+				children[c] = children[c - 1];
+			children[c] = child;
+		}
+		for (int c = 0; c < count; c++)
+			stack[top++] = children[c];
+	}
+
+	if (nearest == INFINITY)
+		return 0;
+	for (int k = 0; k < 3; k++)
+		hit[k] = origin[k] + direction[k] * nearest;
+	return 1;
+}
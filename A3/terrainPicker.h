@@ -0,0 +1,59 @@
+#ifndef TERRAINPICKER_H
+#define TERRAINPICKER_H
+
+#include <vector>
+
+#include "terrainGrid.h"
+
+class ThreadPool;
+
+// Cells per side of smallest blocks in picking quadtree
+static const int pickLeafCells = 4;
+
+// Quadtree of least and greatest heights over terrain cells for casting
+// rays into the height field. Level 0 nodes cover blocks of pickLeafCells
+// cells per side, each level above covers 2 x 2 nodes of the level below,
+// up to one node over the whole grid. Rays and hits are in grid space:
+// x and z in grid units from point (0, 0), y is height
+class TerrainPicker
+{
+public:
+	TerrainPicker(int gridSize); // Grid size in points
+
+	int gridSize, levels;
+
+	// Nodes visited and triangles tested by last cast, for statistics
+	int nodesVisited, trianglesTested;
+
+	// Recompute height bounds of nodes containing points in region, rows
+	// of level 0 nodes split across threads (shared pool if NULL)
+	void update(TerrainGrid &grid, GridRegion region,
+		ThreadPool *pool = NULL);
+
+	// Nearest point where ray from origin along direction hits terrain
+	// (copied into hit), nodes are visited front to back and skipped when
+	// ray passes above or below their heights; returns 0 if ray misses
+	int cast(TerrainGrid &grid, const float *origin, const float *direction,
+		float *hit);
+
+private:
+	// Nodes per side and least/greatest height pairs (row-major) of each
+	// level
+	std::vector<int> perSide;
+	std::vector<std::vector<float> > bounds;
+
+	// Cells per side of nodes at level
+	int span(int level) { return pickLeafCells << level; }
+
+	// Distances along ray (given inverse direction) where it enters and
+	// leaves box of node, returns 0 if ray misses box
+	int enterNode(int level, int i, int j, const float *origin,
+		const float *inverse, float &enter, float &leave);
+
+	// Distance to nearest hit on triangles of cells in level 0 node, or
+	// limit if none is nearer
+	float castLeaf(TerrainGrid &grid, int i, int j, const float *origin,
+		const float *direction, float limit);
+};
+
+#endif
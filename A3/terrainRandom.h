@@ -0,0 +1,34 @@
+#ifndef TERRAINRANDOM_H
+#define TERRAINRANDOM_H
+
+#include <stdint.h>
+
+// SplitMix64 finalizer, mixes all bits of input into output
+static inline uint64_t splitMix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// Counter-based random bits, depend only on seed and counter so values can
+// be drawn in any order or on any thread with the same result
+static inline uint64_t randomBits(uint64_t seed, uint64_t counter)
+{
+	return splitMix64(seed ^ splitMix64(counter));
+}
+
+// Random integer from 0 to n - 1 for seed and counter
+static inline int randomInt(uint64_t seed, uint64_t counter, int n)
+{
+	return (int)(randomBits(seed, counter) % (uint64_t)n);
+}
+
+// Random float from 0 to 1 (exclusive) for seed and counter
+static inline float randomFloat(uint64_t seed, uint64_t counter)
+{
+	return (randomBits(seed, counter) >> 40) / 16777216.0f;
+}
+
+#endif
@@ -0,0 +1,126 @@
+// Import header file
+#include "threadPool.h"
+
+// Pool whose task the current thread is running, NULL outside tasks
+static thread_local ThreadPool *runningPool = NULL;
+
+// Start workers, caller counts as one thread
+ThreadPool::ThreadPool(int threads)
+{
+	if (threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	batchTasks = nextTask = finishedTasks = 0;
+	generation = 0;
+	stopping = 0;
+	for (int i = 1; i < threads; i++)
+		workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+// Stop and join workers
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = 1;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+// Number of threads including caller
+int ThreadPool::size()
+{
+	return workers.size() + 1;
+}
+
+// Claim and run tasks of current batch until none are left
+void ThreadPool::runTasks()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (nextTask < batchTasks)
+	{
+		int task = nextTask++;
+		lock.unlock();
+		ThreadPool *outer = runningPool;
+		runningPool = this;
+		batch(task);
+		runningPool = outer;
+		lock.lock();
+		if (++finishedTasks == batchTasks)
+			done.notify_all();
+	}
+}
+
+// Worker loop: wait for new batch, help run it
+void ThreadPool::work()
+{
+	unsigned long seen = 0;
+	while (1)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+		}
+		runTasks();
+	}
+}
+
+// Run task(i) for i from 0 to tasks - 1 and wait for completion
+void ThreadPool::run(int tasks, std::function<void(int)> task)
+{
+	if (tasks <= 0)
+		return;
+
+	// Batch started by a task of this pool would overwrite the running
+	// batch and wait on itself, so it runs on this thread instead
+	if (runningPool == this)
+	{
+		for (int i = 0; i < tasks; i++)
+			task(i);
+		return;
+	}
+
+	// One batch at a time, callers on other threads wait for their turn
+	std::lock_guard<std::mutex> turn(callers);
+
+	// Publish batch to workers
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batch = task;
+		batchTasks = tasks;
+		nextTask = finishedTasks = 0;
+		generation++;
+	}
+	wake.notify_all();
+
+	// Help out, then wait for tasks still running on workers
+	runTasks();
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return finishedTasks == batchTasks; });
+}
+
+// Split rows into a few bands per thread so uneven bands balance out
+void ThreadPool::forRows(int count, std::function<void(int, int)> band)
+{
+	int bands = size() * 4;
+	if (bands > count)
+		bands = count;
+	run(bands, [&](int i)
+	{
+		band((long)count * i / bands, (long)count * (i + 1) / bands - 1);
+	});
+}
+
+// Pool shared by terrain code, started on first use
+ThreadPool &ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
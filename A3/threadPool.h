@@ -0,0 +1,47 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running numbered tasks, caller waits until
+// every task of a batch has finished. Batches from different threads run
+// one after another, and a batch started from within a task of the same
+// pool runs on the calling thread alone
+class ThreadPool
+{
+public:
+	ThreadPool(int threads = 0); // Number of threads, 0 for all cores
+	~ThreadPool(); // Destructor
+
+	// Number of threads including caller
+	int size();
+
+	// Run task(i) for i from 0 to tasks - 1 and wait for completion
+	void run(int tasks, std::function<void(int)> task);
+
+	// Split rows from 0 to count - 1 into bands, run band(first, last)
+	// for each and wait for completion
+	void forRows(int count, std::function<void(int, int)> band);
+
+	// Pool shared by terrain code
+	static ThreadPool &shared();
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex callers, mutex;
+	std::condition_variable wake, done;
+	std::function<void(int)> batch;
+	int batchTasks, nextTask, finishedTasks;
+	unsigned long generation;
+	int stopping;
+
+	// Worker loop and task claiming shared with caller
+	void work();
+	void runTasks();
+};
+
+#endif
@@ -0,0 +1,483 @@
+// Standard C++ library imports
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+// Local imports
+#include "tileCache.h"
+#include "threadPool.h"
+
+// Magic bytes and version of tiled terrain files
+static const char tileFileMagic[4] = { 'A', '3', 'T', 'L' };
+static const uint32_t tileFileVersion = 1;
+
+// Header and tile records start on page boundaries
+static const uint64_t tileAlignment = 4096;
+
+// Floats per loaded vertex (position, normal and color)
+static const int vertexFloats = 9;
+
+// Fewest slots, enough for top tile and its children whatever the budget
+static const size_t minSlots = 8;
+
+// Number of tiles per side at level of terrain with given size
+static int levelTiles(int size, int tileSize, int level)
+{
+	uint64_t span = (uint64_t)tileSize << level;
+	int tiles = (int)((size - 1 + span - 1) / span);
+	return tiles > 1 ? tiles : 1;
+}
+
+// Constructor: open tiled file, allocate slots and start I/O thread
+TileCache::TileCache(const char *path, size_t budget, const float *lowColor,
+	const float *highColor)
+{
+	counters.hits = counters.misses = counters.stalls = 0;
+	counters.loads = counters.evictions = 0;
+	counters.stallTime = 0;
+	frame = 1;
+	loaded = 0;
+	stopping = 0;
+	points = 0;
+	memcpy(this->lowColor, lowColor, sizeof(this->lowColor));
+	memcpy(this->highColor, highColor, sizeof(this->highColor));
+
+	// Header must describe a pyramid that fits in file
+	memset(&header, 0, sizeof(header));
+	file = ::open(path, O_RDONLY);
+	struct stat status;
+	if (file < 0 || fstat(file, &status) != 0
+		|| pread(file, &header, sizeof(header), 0) != sizeof(header))
+	{
+		printf("Could not open tiled terrain %s.\n", path);
+		if (file >= 0)
+			close(file);
+		file = -1;
+		return;
+	}
+	uint64_t tiles = 0;
+	for (uint32_t level = 0; level < header.levels && level < 32; level++)
+	{
+		levelStarts.push_back(tiles);
+		uint64_t side = levelTiles(header.size, header.tileSize, level);
+		tiles += side * side;
+	}
+	const char *problem = NULL;
+	if (memcmp(header.magic, tileFileMagic, sizeof(tileFileMagic)) != 0)
+		problem = "not a tiled terrain";
+	else if (header.version != tileFileVersion)
+		problem = "unsupported version";
+	else if (header.size < 2 || header.tileSize < 1 || header.levels < 1
+		|| header.levels > 32
+		|| levelTiles(header.size, header.tileSize, header.levels - 1) != 1)
+		problem = "invalid tile pyramid";
+	else if (header.tileBytes < (uint64_t)(header.tileSize + 1)
+		* (header.tileSize + 1) * 4 * sizeof(float)
+		|| header.dataOffset + tiles * header.tileBytes
+		> (uint64_t)status.st_size)
+		problem = "tiles missing";
+	if (problem != NULL)
+	{
+		printf("Could not load tiled terrain %s: %s.\n", path, problem);
+		close(file);
+		file = -1;
+		return;
+	}
+
+	// Vertices of a tile are its points and a skirt ring of four edges
+	int side = header.tileSize + 1;
+	points = side * side;
+	size_t vertices = (size_t)points + side * 4;
+	size_t count = budget / (vertices * vertexFloats * sizeof(float));
+	count = count > minSlots ? count : minSlots;
+	vertexBlock.resize(count * vertices * vertexFloats);
+	slots.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		slots[i].key = 0;
+		slots[i].level = slots[i].x = slots[i].z = 0;
+		slots[i].state = TILE_EMPTY;
+		slots[i].lastUsed = 0;
+		slots[i].vertices = &vertexBlock[i * vertices * vertexFloats];
+	}
+
+	// Cells use same diagonal and winding as full detail mesh
+	for (int i = 0; i < side - 1; i++)
+	{
+		for (int j = 0; j < side - 1; j++)
+		{
+			unsigned int p00 = i * side + j, p01 = p00 + 1;
+			unsigned int p10 = p00 + side, p11 = p10 + 1;
+			indices.insert(indices.end(), { p00, p11, p10, p00, p01, p11 });
+		}
+	}
+
+	// Skirts hang from edges (lower x, upper x, lower z, upper z), seen
+	// from either side so winding does not matter
+	for (int edge = 0; edge < 4; edge++)
+	{
+		for (int k = 0; k < side - 1; k++)
+		{
+			int i0 = edge == 0 ? 0 : edge == 1 ? side - 1 : k;
+			int j0 = edge == 2 ? 0 : edge == 3 ? side - 1 : k;
+			int i1 = edge < 2 ? i0 : k + 1, j1 = edge < 2 ? k + 1 : j0;
+			unsigned int a = i0 * side + j0, b = i1 * side + j1;
+			unsigned int c = points + edge * side + k, d = c + 1;
+			indices.insert(indices.end(), { a, b, d, a, d, c,
+				a, d, b, a, c, d });
+		}
+	}
+
+	worker = std::thread(&TileCache::work, this);
+}
+
+// Destructor, stops I/O thread
+TileCache::~TileCache()
+{
+	if (file < 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = 1;
+	}
+	wake.notify_all();
+	worker.join();
+	close(file);
+}
+
+// Check whether file was opened
+int TileCache::valid()
+{
+	return file >= 0;
+}
+
+// Number of tile slots
+int TileCache::capacity()
+{
+	return slots.size();
+}
+
+// Number of slots holding a loaded tile
+int TileCache::resident()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	int count = 0;
+	for (size_t i = 0; i < slots.size(); i++)
+		count += slots[i].state == TILE_READY;
+	return count;
+}
+
+// Number of tiles per side at level
+int TileCache::tilesPerSide(int level)
+{
+	return levelTiles(header.size, header.tileSize, level);
+}
+
+// Key of tile at level and position
+uint64_t TileCache::tileKey(int level, int x, int z)
+{
+	return (uint64_t)level << 56 | (uint64_t)x << 28 | (uint64_t)z;
+}
+
+// Start new frame, requests from previous frame not yet started are
+// dropped and tiles used in this frame are never evicted during it
+void TileCache::beginFrame()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	frame++;
+	requests.clear();
+	queued.clear();
+}
+
+// Loaded tile if resident (marked as used), otherwise queue it for loading
+// (lower priority first) and return NULL
+const Tile *TileCache::find(int level, int x, int z, float priority)
+{
+	uint64_t key = tileKey(level, x, z);
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unordered_map<uint64_t, int>::iterator slot = slotOfTile.find(key);
+	if (slot != slotOfTile.end() && slots[slot->second].state == TILE_READY)
+	{
+		slots[slot->second].lastUsed = frame;
+		counters.hits++;
+		return &slots[slot->second];
+	}
+
+	// Tiles already loading or queued are not requested twice
+	counters.misses++;
+	if (slot == slotOfTile.end() && queued.insert(key).second)
+	{
+		requests.push_back(std::make_pair(priority, key));
+		wake.notify_one();
+	}
+	return NULL;
+}
+
+// Loaded tile, waiting for I/O thread if not resident
+const Tile *TileCache::wait(int level, int x, int z)
+{
+	const Tile *tile = find(level, x, z, -1);
+	if (tile != NULL)
+		return tile;
+
+	// Request again if dropped because every slot was in use
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	uint64_t key = tileKey(level, x, z);
+	std::unique_lock<std::mutex> lock(mutex);
+	counters.stalls++;
+	std::unordered_map<uint64_t, int>::iterator slot;
+	while ((slot = slotOfTile.find(key)) == slotOfTile.end()
+		|| slots[slot->second].state != TILE_READY)
+	{
+		if (slot == slotOfTile.end() && queued.insert(key).second)
+		{
+			requests.push_back(std::make_pair(-1.0f, key));
+			wake.notify_one();
+		}
+		done.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	slots[slot->second].lastUsed = frame;
+	counters.stallTime += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+	return &slots[slot->second];
+}
+
+// Number of tiles loaded since cache was opened
+unsigned long TileCache::completed()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return loaded;
+}
+
+// Copy of statistics, taken under lock since I/O thread updates them
+TileCacheStats TileCache::statistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return counters;
+}
+
+// Slot to load a tile into, empty or least recently used before this
+// frame, -1 if every slot is in use
+int TileCache::freeSlot()
+{
+	int best = -1;
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		if (slots[i].state == TILE_EMPTY)
+			return i;
+		if (slots[i].state == TILE_READY && slots[i].lastUsed < frame
+			&& (best < 0 || slots[i].lastUsed < slots[best].lastUsed))
+			best = i;
+	}
+	return best;
+}
+
+// I/O thread loop: load most urgent request into a free slot, reading
+// outside lock so drawing continues meanwhile
+void TileCache::work()
+{
+	std::vector<float> buffer((size_t)points * 4);
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		while (!stopping && requests.empty())
+			wake.wait(lock);
+		if (stopping)
+			return;
+
+		// Most urgent request is taken first
+		std::vector<std::pair<float, uint64_t>>::iterator request =
+			std::min_element(requests.begin(), requests.end());
+		uint64_t key = request->second;
+		requests.erase(request);
+		queued.erase(key);
+		int slot = freeSlot();
+		if (slot < 0 || slotOfTile.count(key))
+			continue;
+
+		// Evict previous tile of slot
+		Tile &tile = slots[slot];
+		if (tile.state == TILE_READY)
+		{
+			slotOfTile.erase(tile.key);
+			counters.evictions++;
+		}
+		tile.key = key;
+		tile.level = key >> 56;
+		tile.x = key >> 28 & 0xfffffff;
+		tile.z = key & 0xfffffff;
+		tile.state = TILE_LOADING;
+		slotOfTile[key] = slot;
+
+		lock.unlock();
+		readTile(tile, buffer);
+		lock.lock();
+		tile.state = TILE_READY;
+		tile.lastUsed = frame;
+		counters.loads++;
+		loaded++;
+		done.notify_all();
+	}
+}
+
+// Read tile record and build its vertices
+void TileCache::readTile(Tile &tile, std::vector<float> &buffer)
+{
+	// Record holds heights followed by normals
+	uint64_t record = levelStarts[tile.level]
+		+ (uint64_t)tile.x * tilesPerSide(tile.level) + tile.z;
+	char *bytes = (char*)buffer.data();
+	size_t size = buffer.size() * sizeof(float), filled = 0;
+	off_t offset = header.dataOffset + record * header.tileBytes;
+	while (filled < size)
+	{
+		ssize_t read = pread(file, bytes + filled, size - filled,
+			offset + filled);
+		if (read <= 0)
+		{
+			printf("Could not read tile %d (%d, %d).\n", tile.level,
+				tile.x, tile.z);
+			memset(bytes + filled, 0, size - filled);
+			break;
+		}
+		filled += read;
+	}
+
+	// Points beyond last grid point repeat it, like in file
+	int side = header.tileSize + 1, step = 1 << tile.level;
+	int origin = 0 - (int)(header.size - 1) / 2, last = header.size - 1;
+	for (int i = 0; i < side; i++)
+	{
+		for (int j = 0; j < side; j++)
+		{
+			int p = i * side + j;
+			int64_t x = ((int64_t)tile.x * header.tileSize + i) * step;
+			int64_t z = ((int64_t)tile.z * header.tileSize + j) * step;
+			float *vertex = &tile.vertices[p * vertexFloats];
+			vertex[0] = origin + (x < last ? x : last);
+			vertex[1] = buffer[p];
+			vertex[2] = origin + (z < last ? z : last);
+			memcpy(vertex + 3, &buffer[points + p * 3], 3 * sizeof(float));
+
+			// Color gradient between low and high colors
+			float height = header.greatestHeight > 0
+				? buffer[p] / header.greatestHeight : 0;
+			for (int k = 0; k < 3; k++)
+				vertex[6 + k] = lowColor[k] * (1 - height)
+					+ highColor[k] * height;
+		}
+	}
+
+	// Skirt copies edge points lowered by more than coarser levels can
+	// differ from them
+	float depth = step * 2 + header.greatestHeight * 0.02f;
+	for (int edge = 0; edge < 4; edge++)
+	{
+		for (int k = 0; k < side; k++)
+		{
+			int i = edge == 0 ? 0 : edge == 1 ? side - 1 : k;
+			int j = edge == 2 ? 0 : edge == 3 ? side - 1 : k;
+			float *vertex = &tile.vertices[(points + edge * side + k)
+				* vertexFloats];
+			memcpy(vertex, &tile.vertices[(i * side + j) * vertexFloats],
+				vertexFloats * sizeof(float));
+			vertex[1] -= depth;
+		}
+	}
+}
+
+// Write tiled terrain file from mapped height map, tile size in cells,
+// returns 0 and prints reason on failure
+int TileCache::write(const char *path, const HeightMap &map, int tileSize)
+{
+	int size = map.header.width;
+
+	// Levels halve sampling until one tile covers whole terrain
+	TileFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, tileFileMagic, sizeof(tileFileMagic));
+	header.version = tileFileVersion;
+	header.size = size;
+	header.tileSize = tileSize;
+	header.levels = 1;
+	while (levelTiles(size, tileSize, header.levels - 1) > 1)
+		header.levels++;
+	header.greatestHeight = map.header.greatestHeight;
+	header.seed = map.header.seed;
+	header.dataOffset = tileAlignment;
+	int side = tileSize + 1, points = side * side;
+	header.tileBytes = ((uint64_t)points * 4 * sizeof(float)
+		+ tileAlignment - 1) / tileAlignment * tileAlignment;
+
+	// Header padded to page boundary
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		printf("Could not create tiled terrain %s.\n", path);
+		return 0;
+	}
+	std::vector<char> padding(tileAlignment, 0);
+	memcpy(padding.data(), &header, sizeof(header));
+	int written = fwrite(padding.data(), 1, padding.size(), file)
+		== padding.size();
+
+	// Tiles level by level, row-major within level, points of a tile
+	// computed in parallel by rows
+	std::vector<float> record(header.tileBytes / sizeof(float), 0);
+	int last = size - 1;
+	for (uint32_t level = 0; written && level < header.levels; level++)
+	{
+		int tiles = levelTiles(size, tileSize, level), step = 1 << level;
+		for (int64_t tile = 0; written && tile < (int64_t)tiles * tiles;
+			tile++)
+		{
+			int64_t tileX = tile / tiles * tileSize, tileZ = tile % tiles
+				* tileSize;
+			ThreadPool::shared().forRows(side, [&](int first, int lastRow)
+			{
+				for (int i = first; i <= lastRow; i++)
+				{
+					int64_t x = std::min((tileX + i) * step, (int64_t)last);
+					for (int j = 0; j < side; j++)
+					{
+						int64_t z = std::min((tileZ + j) * step,
+							(int64_t)last);
+
+						// Normal from central differences over sample
+						// step, one-sided at terrain edges
+						int x0 = std::max(x - step, (int64_t)0);
+						int x1 = std::min(x + step, (int64_t)last);
+						int z0 = std::max(z - step, (int64_t)0);
+						int z1 = std::min(z + step, (int64_t)last);
+						float normal[3] = {
+							(map.height(x0, z) - map.height(x1, z))
+								/ (x1 - x0),
+							1,
+							(map.height(x, z0) - map.height(x, z1))
+								/ (z1 - z0) };
+						float length = sqrtf(normal[0] * normal[0]
+							+ 1 + normal[2] * normal[2]);
+						int p = i * side + j;
+						record[p] = map.height(x, z);
+						for (int k = 0; k < 3; k++)
+							record[points + p * 3 + k] = normal[k] / length;
+					}
+				}
+			});
+			written = fwrite(record.data(), 1, header.tileBytes, file)
+				== header.tileBytes;
+		}
+	}
+	if (fclose(file) != 0 || !written)
+	{
+		printf("Could not write tiled terrain %s.\n", path);
+		return 0;
+	}
+	return 1;
+}
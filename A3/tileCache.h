@@ -0,0 +1,136 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "heightMap.h"
+
+// Header at start of tiled terrain file. Level L of the tile pyramid samples
+// every 2^L grid points, each tile covers tile size cells of its level and
+// stores (tile size + 1)^2 points (shared edges are repeated), first all
+// heights then normals (3 floats per point), records are page aligned and
+// follow level by level, row-major within a level
+struct TileFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t size;
+	uint32_t tileSize;
+	uint32_t levels;
+	float greatestHeight;
+	uint64_t seed;
+	uint64_t dataOffset;
+	uint64_t tileBytes;
+};
+
+// States of tile slots
+enum TileState { TILE_EMPTY, TILE_LOADING, TILE_READY };
+
+// Tile loaded into memory as interleaved vertices (position, normal and
+// color, 9 floats each), points of tile row-major then a skirt ring
+// hanging below each edge to hide cracks between levels
+struct Tile
+{
+	uint64_t key;
+	int level, x, z;
+	int state;
+	unsigned long lastUsed;
+	float *vertices;
+};
+
+// Statistics of a tile cache: lookups of resident and missing tiles,
+// waits for tiles and time spent waiting, tiles read and tiles evicted
+struct TileCacheStats
+{
+	long hits, misses, stalls, loads, evictions;
+	double stallTime;
+};
+
+// Fixed number of tile slots within a memory budget, filled from tiled
+// terrain file by a background I/O thread and reused least recently used
+// first
+class TileCache
+{
+public:
+	// Open tiled file, budget in bytes for tile vertices, terrain colors for
+	// lowest and greatest heights
+	TileCache(const char *path, size_t budget, const float *lowColor,
+		const float *highColor);
+	~TileCache(); // Destructor, stops I/O thread
+
+	TileFileHeader header;
+
+	// Triangles of a tile including skirts, indices into its vertices
+	std::vector<unsigned int> indices;
+
+	// Check whether file was opened
+	int valid();
+
+	// Number of tile slots and slots holding a loaded tile
+	int capacity();
+	int resident();
+
+	// Number of tiles per side at level
+	int tilesPerSide(int level);
+
+	// Start new frame, requests from previous frame not yet started are
+	// dropped and tiles used in this frame are never evicted during it
+	void beginFrame();
+
+	// Loaded tile if resident (marked as used), otherwise queue it for
+	// loading (lower priority first) and return NULL
+	const Tile *find(int level, int x, int z, float priority);
+
+	// Loaded tile, waiting for I/O thread if not resident
+	const Tile *wait(int level, int x, int z);
+
+	// Number of tiles loaded since cache was opened
+	unsigned long completed();
+
+	// Copy of statistics, taken under lock since I/O thread updates them
+	TileCacheStats statistics();
+
+	// Write tiled terrain file from mapped height map, tile size in cells,
+	// returns 0 and prints reason on failure
+	static int write(const char *path, const HeightMap &map, int tileSize);
+
+private:
+	int file;
+	int points;
+	std::vector<Tile> slots;
+	std::vector<float> vertexBlock;
+	std::unordered_map<uint64_t, int> slotOfTile;
+	std::unordered_set<uint64_t> queued;
+	std::vector<std::pair<float, uint64_t>> requests;
+	unsigned long frame;
+	unsigned long loaded;
+	TileCacheStats counters;
+	std::vector<uint64_t> levelStarts;
+	float lowColor[3], highColor[3];
+
+	// I/O thread and its synchronization
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	int stopping;
+
+	// Key of tile at level and position
+	static uint64_t tileKey(int level, int x, int z);
+
+	// I/O thread loop and reading of one tile into slot
+	void work();
+	void readTile(Tile &tile, std::vector<float> &buffer);
+
+	// Slot to load a tile into, empty or least recently used before this
+	// frame, -1 if every slot is in use
+	int freeSlot();
+};
+
+#endif
@@ -0,0 +1,173 @@
+// Standard C++ library imports
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <new>
+
+// OpenGL and GLUT imports
+#ifdef __APPLE__
+#  include <OpenGL/gl.h>
+#  include <OpenGL/glu.h>
+#  include <GLUT/glut.h>
+#else
+#  include <GL/gl.h>
+#  include <GL/glu.h>
+#  include <GL/freeglut.h>
+#endif
+
+// Local imports
+#include "objLoader.h"
+
+// Allocations and bytes requested through operator new so far
+static long allocations = 0;
+static size_t allocatedBytes = 0;
+
+// Count every allocation (arrays included), then allocate as usual
+void *operator new(size_t size)
+{
+	allocations++;
+	allocatedBytes += size;
+	void *block = malloc(size);
+	if (block == NULL)
+		throw std::bad_alloc();
+	return block;
+}
+
+// Release allocation counted above
+void operator delete(void *block) noexcept
+{
+	free(block);
+}
+
+// Milliseconds elapsed since given start time
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+// Report mesh size, allocations made while loading, and best load time of
+// several passes with parsing speed for each object file
+static void benchmarkLoad(int count, char **paths)
+{
+	printf("%-20s %9s %9s %8s %12s %10s %8s\n", "file", "vertices",
+		"triangles", "allocs", "alloc (KB)", "load (ms)", "MB/s");
+	for (int i = 0; i < count; i++)
+	{
+		struct stat status;
+		double megabytes = stat(paths[i], &status) == 0
+			? status.st_size / 1048576.0 : 0;
+		double best = 0;
+		long loadAllocations = 0;
+		size_t loadBytes = 0;
+		int vertices = 0, triangles = 0;
+		for (int pass = 0; pass < 5; pass++)
+		{
+			long firstAllocation = allocations;
+			size_t firstByte = allocatedBytes;
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			objLoader *mesh = new objLoader(paths[i]);
+			double time = elapsed(start);
+			if (pass == 0 || time < best)
+				best = time;
+
+			// Loader itself is not counted
+			loadAllocations = allocations - firstAllocation - 1;
+			loadBytes = allocatedBytes - firstByte - sizeof(objLoader);
+			vertices = mesh->vertexCount;
+			triangles = mesh->triangleCount;
+			delete mesh;
+		}
+		printf("%-20s %9d %9d %8ld %12.1f %10.2f %8.1f\n", paths[i],
+			vertices, triangles, loadAllocations, loadBytes / 1024.0, best,
+			megabytes / best * 1000);
+	}
+}
+
+// Copies of each mesh drawn per frame, and frames timed per mode
+static const int drawCopies = 20;
+static const int drawFrames = 100;
+
+// Draw copies of mesh in a row across view, immediately or from display list
+static void drawFrame(objLoader *mesh, int list)
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	for (int i = 0; i < drawCopies; i++)
+	{
+		glPushMatrix();
+		glTranslatef((i % 5 - 2) * 3, (i / 5 - 1.5f) * 3, -20);
+		if (list)
+			mesh->drawObj();
+		else
+			mesh->drawTriangles(0);
+		glPopMatrix();
+	}
+	glFinish();
+	glutSwapBuffers();
+}
+
+// Report average frame time of drawing each object file lit, sending its
+// triangles every frame and calling its display list (needs a window)
+static void benchmarkDraw(int count, char **paths)
+{
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_LIGHT0);
+	glMatrixMode(GL_PROJECTION);
+	gluPerspective(45, 800.0 / 600.0, 1, 100);
+	glMatrixMode(GL_MODELVIEW);
+	printf("%-20s %9s %14s %10s %8s\n", "file", "triangles",
+		"immediate (ms)", "list (ms)", "speedup");
+	for (int i = 0; i < count; i++)
+	{
+		objLoader *mesh = new objLoader(paths[i]);
+		double times[2];
+		for (int list = 0; list < 2; list++)
+		{
+			// First frame compiles display list, so it is not timed
+			drawFrame(mesh, list);
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			for (int frame = 0; frame < drawFrames; frame++)
+				drawFrame(mesh, list);
+			times[list] = elapsed(start) / drawFrames;
+		}
+		printf("%-20s %9d %14.2f %10.2f %7.2fx\n", paths[i],
+			mesh->triangleCount, times[0], times[1], times[0] / times[1]);
+		delete mesh;
+	}
+}
+
+// Main function: run benchmarks for object files given in command line,
+// with --draw first to time drawing instead of loading
+int main(int argc, char **argv)
+{
+	// Default object files if none given
+	char *defaults[] =
+	{
+		(char*)"Objects/minion.obj", (char*)"Objects/rocket.obj",
+		(char*)"Objects/bomb.obj", (char*)"Objects/coin.obj",
+		(char*)"Objects/rock.obj"
+	};
+	int draw = argc > 1 && strcmp(argv[1], "--draw") == 0;
+	int count = argc - 1 - draw;
+	char **paths = count > 0 ? argv + 1 + draw : defaults;
+	if (count == 0)
+		count = 5;
+	if (!draw)
+	{
+		benchmarkLoad(count, paths);
+		return 0;
+	}
+
+	// Window gives drawing context, its contents are not looked at
+	glutInit(&argc, argv);
+	glutInitDisplayMode(GLUT_RGBA | GLUT_DEPTH | GLUT_DOUBLE);
+	glutInitWindowSize(800, 600);
+	glutCreateWindow("Benchmark");
+	benchmarkDraw(count, paths);
+	return 0;
+}
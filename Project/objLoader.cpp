@@ -1,6 +1,8 @@
 // Standard C++ library imports
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // OpenGL and GLUT imports
 #ifdef __APPLE__
@@ -16,200 +18,458 @@
 // Import header file
 #include "objLoader.h"
 
-// Standard input-output stream
+// Standard input-output stream and file mapping
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <iostream>
-#include <fstream>
+#include <map>
 #include <string>
+#include <vector>
 using namespace std;
 
-// Read object file
-objLoader::objLoader(char* filepath)
+// Skip spaces, tabs and carriage returns within line
+static const char *skipSpaces(const char *text, const char *end)
 {
-	// Set filepath as given
-	this->filepath = filepath;
+	while (text < end && (*text == ' ' || *text == '\t' || *text == '\r'))
+		text++;
+	return text;
+}
 
-	// Initialize vertices and faces vectors
-	vertices = new vector<vector<float>*>;
-	faces = new vector<vector<int>*>;
+// Skip rest of token up to next space or line end
+static const char *skipToken(const char *text, const char *end)
+{
+	while (text < end && *text != ' ' && *text != '\t' && *text != '\r'
+		&& *text != '\n')
+		text++;
+	return text;
+}
 
-	// Open .obj file
-	fstream *objFile = new fstream;
-	objFile->open(filepath, ios_base::in);
+// Start of line after the one containing text
+static const char *nextLine(const char *text, const char *end)
+{
+	const char *newline = (const char*)memchr(text, '\n', end - text);
+	return newline != NULL ? newline + 1 : end;
+}
 
-	// Exit with failure status if can't open file
-	if (!objFile->is_open())
+// Parse integer with optional sign, returns position after it
+static const char *parseInt(const char *text, const char *end, long &value)
+{
+	int negative = text < end && *text == '-';
+	if (text < end && (*text == '-' || *text == '+'))
+		text++;
+	value = 0;
+	for (; text < end && *text >= '0' && *text <= '9'; text++)
+		value = value * 10 + (*text - '0');
+	if (negative)
+		value = -value;
+	return text;
+}
+
+// Parse decimal number with optional sign, fraction and exponent, returns
+// position after it. Up to 19 significant digits are kept as an integer,
+// which is scaled once by an exact power of ten when possible
+static const char *parseFloat(const char *text, const char *end,
+	float &value)
+{
+	static const double powers[] =
 	{
-		std::cout << "Not able to open the file." << std::endl;
-		exit(EXIT_FAILURE);
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	int negative = text < end && *text == '-';
+	if (text < end && (*text == '-' || *text == '+'))
+		text++;
+
+	// Digits before and after point, exponent counts dropped digits
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	for (; text < end && *text >= '0' && *text <= '9'; text++)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*text - '0');
+			digits += mantissa > 0;
+		}
+		else
+			exponent++;
 	}
-
-	// Read until the end of the file
-	string line;
-	while (!objFile->eof())
+	if (text < end && *text == '.')
 	{
-		// Read line by line
-		std::getline(*objFile, line);
-
-		// Split line by space
-		vector<string> *param = this -> splitStr(line, ' ');
-
-		// Prefix is 'v' for vertices
-		if (param->at(0) == "v")
+		for (text++; text < end && *text >= '0' && *text <= '9'; text++)
 		{
-			// Eliminate prefix and keep values
-			param->erase(param->begin());
-
-			// Convert x, y, z coordinates from str to float
-			vector<float> *temp = new vector<float>;
-			for (int i = 0; i < param->size(); i++)
+			if (digits < 19)
 			{
-				temp->push_back(this->convertStr(param->at(i)));
+				mantissa = mantissa * 10 + (*text - '0');
+				digits += mantissa > 0;
+				exponent--;
 			}
-
-			// Append vertices
-			vertices->push_back(temp);
 		}
+	}
+	if (text < end && (*text == 'e' || *text == 'E'))
+	{
+		long power;
+		text = parseInt(text + 1, end, power);
+		exponent += power;
+	}
 
-		// Prefix is 'f' for faces
-		else if (param->at(0) == "f")
-		{
-			// Eliminate prefix and keep values
-			param->erase(param->begin());
+	// Exact power of ten for usual values, repeated scaling otherwise
+	double result = mantissa;
+	if (exponent < 0 && exponent >= -22)
+		result /= powers[-exponent];
+	else if (exponent > 0 && exponent <= 22)
+		result *= powers[exponent];
+	else if (exponent != 0)
+		result *= pow(10.0, exponent);
+	value = negative ? -result : result;
+	return text;
+}
 
-			// Convert index from str to int
-			vector<int> *vertexIndex = new vector<int>;
-			for (int i = 0; i < param->size(); i++)
-			{
-				int faceIndex = this->convertStr(param->at(i));
-				vertexIndex->push_back(--faceIndex);
-			}
+// Kinds of lines that are read
+enum LineKind { POSITION, TEX_COORD, NORMAL, FACE, OTHER };
 
-			// Finally save faces information
-			faces->push_back(vertexIndex);
-		}
+// Kind of line from its keyword, which ends at a space
+static int lineKind(const char *line, const char *end)
+{
+	int length = end - line;
+	int spaced = length > 1 && (line[1] == ' ' || line[1] == '\t');
+	if (line[0] == 'v' && spaced)
+		return POSITION;
+	if (line[0] == 'f' && spaced)
+		return FACE;
+	if (length > 2 && line[0] == 'v' && (line[2] == ' ' || line[2] == '\t'))
+		return line[1] == 't' ? TEX_COORD : line[1] == 'n' ? NORMAL : OTHER;
+	return OTHER;
+}
 
-		// Delete temp param vector
-		delete param;
+// Number of tokens from text to end of line
+static int countTokens(const char *text, const char *end)
+{
+	int tokens = 0, inToken = 0;
+	for (; text < end && *text != '\n'; text++)
+	{
+		int space = *text == ' ' || *text == '\t' || *text == '\r';
+		tokens += !space && !inToken;
+		inToken = !space;
 	}
+	return tokens;
+}
 
-	// Close .obj file
-	objFile->close();
+// Parse face corner token v, v/vt, v//vn or v/vt/vn, indices are made
+// relative to 0 using counts read so far for negative ones, and are -1
+// where missing (0 in file is invalid and becomes -2)
+static const char *parseCorner(const char *text, const char *end,
+	const int *counts, int *corner)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		corner[k] = -1;
+		if (k > 0)
+		{
+			if (text >= end || *text != '/')
+				continue;
+			text++;
+		}
+		if (text >= end || (*text != '-' && (*text < '0' || *text > '9')))
+			continue;
+		long index;
+		text = parseInt(text, end, index);
+		corner[k] = index > 0 ? index - 1 : index < 0 ? counts[k] + index
+			: -2;
+	}
+	return skipToken(text, end);
 }
 
-// Clean-up of memory
-objLoader::~objLoader()
+// Vertex of mesh for corner (position, texture and normal index), new
+// corners are appended to corner list and found again through open
+// addressing table of vertex numbers (0 for empty slots)
+static uint32_t findVertex(const int *corner, vector<int> &corners,
+	vector<uint32_t> &table)
 {
-	delete this->vertices;
-	delete this->faces;
+	size_t mask = table.size() - 1;
+	size_t slot = ((size_t)corner[0] * 73856093u ^ (size_t)corner[1]
+		* 19349663u ^ (size_t)corner[2] * 83492791u) & mask;
+	for (; table[slot] != 0; slot = (slot + 1) & mask)
+	{
+		const int *other = &corners[(table[slot] - 1) * 3];
+		if (other[0] == corner[0] && other[1] == corner[1]
+			&& other[2] == corner[2])
+			return table[slot] - 1;
+	}
+	corners.insert(corners.end(), corner, corner + 3);
+	table[slot] = corners.size() / 3;
+	return table[slot] - 1;
 }
 
-// Drawing object
-void objLoader::drawObj()
+// Scale vector to unit length, zero vector stays zero
+static void normalize(float *vector)
 {
-	glBegin(GL_TRIANGLES);
-	for (int i = 0; i < faces->size(); i++) // Each object face
+	float length = sqrtf(vector[0] * vector[0] + vector[1] * vector[1]
+		+ vector[2] * vector[2]);
+	float scale = length > 0 ? 1 / length : 0;
+	for (int k = 0; k < 3; k++)
+		vector[k] *= scale;
+}
+
+// Map object file into memory and scan it in place twice: first counting
+// values and face corners so every buffer is allocated once, then parsing
+// values without copying lines. Faces are split into triangle fans, and
+// each distinct combination of position, texture and normal becomes one
+// vertex of the mesh
+objLoader::objLoader(const char* filepath)
+{
+	// Copy filepath given, nothing compiled for drawing yet
+	this->filepath = filepath;
+	displayLists[0] = displayLists[1] = 0;
+
+	// Exit with failure status if can't open file
+	int file = open(filepath, O_RDONLY);
+	struct stat status;
+	if (file < 0 || fstat(file, &status) != 0)
 	{
-		float coord1[3], coord2[3], coord3[3];
-		float *normal = NULL;
+		std::cout << "Not able to open the file." << std::endl;
+		exit(EXIT_FAILURE);
+	}
 
-		for (int j = 0; j < (faces->at(i))->size(); j++) // Each vertex
+	// Empty file maps nothing and gives empty mesh
+	size_t size = status.st_size;
+	const char *text = NULL;
+	if (size > 0)
+	{
+		void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapping == MAP_FAILED)
+		{
+			std::cout << "Not able to read the file." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		text = (const char*)mapping;
+	}
+	close(file);
+	const char *end = text + size;
+
+	// Count positions, texture coordinates, normals, and corners and
+	// triangles of faces
+	int counts[3] = { 0, 0, 0 }, cornerCount = 0;
+	triangleCount = 0;
+	for (const char *line = text; line < end; line = nextLine(line, end))
+	{
+		int kind = lineKind(line, end);
+		if (kind == FACE)
+		{
+			int corners = countTokens(line + 1, end);
+			cornerCount += corners;
+			triangleCount += corners > 2 ? corners - 2 : 0;
+		}
+		else if (kind != OTHER)
+			counts[kind]++;
+	}
+
+	// Values as read from file, and table of distinct corners with room
+	// to spare so probes stay short
+	vector<float> filePositions(counts[0] * 3);
+	vector<float> fileTexCoords(counts[1] * 2);
+	vector<float> fileNormals(counts[2] * 3);
+	vector<int> corners;
+	corners.reserve(cornerCount * 3);
+	size_t tableSize = 1;
+	while (tableSize < (size_t)cornerCount * 2)
+		tableSize *= 2;
+	vector<uint32_t> table(tableSize, 0);
+	indices = new uint32_t[triangleCount * 3];
+
+	int read[3] = { 0, 0, 0 };
+	uint32_t *index = indices;
+	for (const char *line = text; line < end; line = nextLine(line, end))
+	{
+		const char *value = line + 1;
+		int kind = lineKind(line, end);
+
+		// Keep x, y, z of position, u, v of texture coordinates (w is
+		// ignored) or x, y, z of normal
+		if (kind == POSITION || kind == TEX_COORD || kind == NORMAL)
+		{
+			int components = kind == TEX_COORD ? 2 : 3;
+			float *target = kind == POSITION ? &filePositions[read[0] * 3]
+				: kind == TEX_COORD ? &fileTexCoords[read[1] * 2]
+				: &fileNormals[read[2] * 3];
+			value += kind != POSITION;
+			for (int i = 0; i < components; i++)
+				value = parseFloat(skipSpaces(value, end), end, target[i]);
+			read[kind]++;
+		}
+
+		// Fan of triangles from first corner of face
+		else if (kind == FACE)
 		{
-			int ind = (faces->at(i))->at(j);
-			switch(j)
+			uint32_t first = 0, previous = 0;
+			int corner[3];
+			for (int i = 0;; i++)
 			{
-				case 0: // 1st vertex
-					coord1[0] = (vertices->at(ind))->at(0);
-					coord1[1] = (vertices->at(ind))->at(1);
-					coord1[2] = (vertices->at(ind))->at(2);
-					break;
-				case 1: // 2nd vertex
-					coord2[0] = (vertices->at(ind))->at(0);
-					coord2[1] = (vertices->at(ind))->at(1);
-					coord2[2] = (vertices->at(ind))->at(2);
-					break;
-				case 2: // 3rd vertex
-					coord3[0] = (vertices->at(ind))->at(0);
-					coord3[1] = (vertices->at(ind))->at(1);
-					coord3[2] = (vertices->at(ind))->at(2);
+				value = skipSpaces(value, end);
+				if (value >= end || *value == '\n')
 					break;
+				value = parseCorner(value, end, read, corner);
+				uint32_t vertex = findVertex(corner, corners, table);
+				if (i == 0)
+					first = vertex;
+				if (i >= 2)
+				{
+					*index++ = first;
+					*index++ = previous;
+					*index++ = vertex;
+				}
+				previous = vertex;
 			}
+		}
+	}
+	if (size > 0)
+		munmap((void*)text, size);
 
-			// Calculate norm and draw triangles since we have 3 vertices
-			if (j == 2)
+	// Exit with failure status if a face uses a missing value
+	vertexCount = corners.size() / 3;
+	int hasTexCoords = 0, hasNormals = 0;
+	for (int i = 0; i < vertexCount; i++)
+	{
+		const int *corner = &corners[i * 3];
+		for (int k = 0; k < 3; k++)
+		{
+			if (corner[k] >= counts[k] || corner[k] < (k == 0 ? 0 : -1))
 			{
-				normal = this->getNorm(coord1, coord2, coord3);
-				glNormal3f(normal[0], normal[1], normal[2]);
-
-				glVertex3f(coord1[0], coord1[1], coord1[2]);
-				glVertex3f(coord2[0], coord2[1], coord2[2]);
-				glVertex3f(coord3[0], coord3[1], coord3[2]);
+				std::cout << "Invalid face in " << filepath << "."
+					<< std::endl;
+				exit(EXIT_FAILURE);
 			}
 		}
+		hasTexCoords |= corner[1] >= 0;
+		hasNormals |= corner[2] >= 0;
 	}
-	glEnd();
-}
-
-// Split string by given separator
-vector<string>* objLoader::splitStr(string sentence, char separator)
-{
-	sentence += separator;
 
-	string word = "";
-	vector<string> *words = new vector<string>;
+	// Vertices of mesh from values their corners use, missing texture
+	// coordinates and normals are zero
+	positions = new float[vertexCount * 3];
+	texCoords = hasTexCoords ? new float[vertexCount * 2] : NULL;
+	normals = hasNormals ? new float[vertexCount * 3] : NULL;
+	for (int i = 0; i < vertexCount; i++)
+	{
+		const int *corner = &corners[i * 3];
+		for (int k = 0; k < 3; k++)
+			positions[i * 3 + k] = filePositions[corner[0] * 3 + k];
+		for (int k = 0; hasTexCoords && k < 2; k++)
+			texCoords[i * 2 + k] = corner[1] >= 0
+				? fileTexCoords[corner[1] * 2 + k] : 0;
+		for (int k = 0; hasNormals && k < 3; k++)
+			normals[i * 3 + k] = corner[2] >= 0
+				? fileNormals[corner[2] * 3 + k] : 0;
+	}
+	computeNormals(corners.data(), counts[0]);
 
-	for (int ch = 0; ch< sentence.length(); ch++)
+	// Normals given by file are drawn when smooth, scaled to unit length,
+	// vertices without one take computed smooth normal
+	for (int i = 0; hasNormals && i < vertexCount; i++)
 	{
-		if (sentence[ch] != separator)
-		{
-			word += sentence[ch];
-		}
+		if (corners[i * 3 + 2] >= 0)
+			normalize(&normals[i * 3]);
 		else
-		{
-			words->push_back(word);
-			word = "";
-		}
+			memcpy(&normals[i * 3], &smoothNormals[i * 3],
+				3 * sizeof(float));
 	}
-	return words;
 }
 
-// Converting string to float
-float objLoader::convertStr(string sentence)
+// Flat normals from cross product of triangle edges, whose length is twice
+// the triangle's area, so summing them unnormalized per file position
+// weights smooth normals by area. Vertices split only by texture or normal
+// index share their position's sum and stay smooth across seams
+void objLoader::computeNormals(const int *corners, int positionCount)
 {
-	float val = 0.0f;
-	istringstream buffer(sentence);
-	buffer >> val;
-	return val;
+	flatNormals = new float[triangleCount * 3];
+	smoothNormals = new float[vertexCount * 3];
+	vector<float> sums(positionCount * 3, 0);
+	for (int i = 0; i < triangleCount; i++)
+	{
+		const uint32_t *triangle = &indices[i * 3];
+		const float *a = &positions[triangle[0] * 3];
+		const float *b = &positions[triangle[1] * 3];
+		const float *c = &positions[triangle[2] * 3];
+		float edge1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float edge2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float *normal = &flatNormals[i * 3];
+		normal[0] = edge1[1] * edge2[2] - edge1[2] * edge2[1];
+		normal[1] = edge1[2] * edge2[0] - edge1[0] * edge2[2];
+		normal[2] = edge1[0] * edge2[1] - edge1[1] * edge2[0];
+		for (int j = 0; j < 3; j++)
+			for (int k = 0; k < 3; k++)
+				sums[corners[triangle[j] * 3] * 3 + k] += normal[k];
+		normalize(normal);
+	}
+	for (int i = 0; i < vertexCount; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			smoothNormals[i * 3 + k] = sums[corners[i * 3] * 3 + k];
+		normalize(&smoothNormals[i * 3]);
+	}
 }
 
-// Calculating norm
-float* objLoader::getNorm(float *coord1, float *coord2, float *coord3)
+// Clean-up of memory
+objLoader::~objLoader()
 {
-	// Declare two vectors and cross product
-	float v1[3], v2[3], cross[3];
-
-	// Calculate first vector
-	v1[0] = coord1[0] - coord2[0];
-	v1[1] = coord1[1] - coord2[1];
-	v1[2] = coord1[2] - coord2[2];
-
-	// Calculate second vector
-	v2[0] = coord1[0] - coord3[0];
-	v2[1] = coord1[1] - coord3[1];
-	v2[2] = coord1[2] - coord3[2];
+	delete[] this->positions;
+	delete[] this->texCoords;
+	delete[] this->normals;
+	delete[] this->indices;
+	delete[] this->flatNormals;
+	delete[] this->smoothNormals;
+	for (int i = 0; i < 2; i++)
+		if (displayLists[i] != 0)
+			glDeleteLists(displayLists[i], 1);
+}
 
-	// Calculate cross product
-	cross[0] = v1[1] * v2[2] - v2[1] * v1[2];
-	cross[1] = v2[0] * v1[2] - v1[0] * v2[2];
-	cross[2] = v1[0] * v2[1] - v2[0] * v1[1];
+// Meshes loaded so far by file path, each loaded once and kept until exit
+objLoader* objLoader::load(const char* filepath)
+{
+	static map<string, objLoader*> meshes;
+	objLoader *&mesh = meshes[filepath];
+	if (mesh == NULL)
+		mesh = new objLoader(filepath);
+	return mesh;
+}
 
-	// Calculate normalization factor
-	float fact = sqrt(pow(cross[0], 2) + pow(cross[1], 2)
-		+ pow(cross[2], 2));
+// Drawing object with one call: its triangles are compiled into a display
+// list on first draw, so OpenGL keeps the mesh and later draws send nothing
+// but the call (needs current context)
+void objLoader::drawObj(int smooth)
+{
+	smooth = smooth != 0;
+	if (displayLists[smooth] == 0)
+	{
+		displayLists[smooth] = glGenLists(1);
+		glNewList(displayLists[smooth], GL_COMPILE);
+		drawTriangles(smooth);
+		glEndList();
+	}
+	glCallList(displayLists[smooth]);
+}
 
-	// Normalize vectors (to be returned)
-	static float norm[3];
-	norm[0] = cross[0] / fact;
-	norm[1] = cross[1] / fact;
-	norm[2] = cross[2] / fact;
-	return norm;
+// Sending triangles, with normals computed at load (one per triangle), or
+// if smooth one per vertex from file or else computed at load, and texture
+// coordinates when mesh has them
+void objLoader::drawTriangles(int smooth)
+{
+	const float *vertexNormals = normals != NULL ? normals : smoothNormals;
+	glBegin(GL_TRIANGLES);
+	for (int i = 0; i < triangleCount; i++) // Each object face
+	{
+		uint32_t *corner = &indices[i * 3];
+		if (!smooth)
+			glNormal3fv(&flatNormals[i * 3]);
+		for (int j = 0; j < 3; j++)
+		{
+			if (smooth)
+				glNormal3fv(&vertexNormals[corner[j] * 3]);
+			if (texCoords != NULL)
+				glTexCoord2fv(&texCoords[corner[j] * 2]);
+			glVertex3fv(&positions[corner[j] * 3]);
+		}
+	}
+	glEnd();
 }
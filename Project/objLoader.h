@@ -4,32 +4,54 @@
 #include <iostream>
 #include <cstdlib>
 #include <fstream>
-#include <sstream>
 #include <vector>
+#include <string>
 #include <cmath>
+#include <stdint.h>
 
 using namespace std;
 
 class objLoader{
 public:
-	objLoader(char* filepath); // Filepath of .obj file
+	objLoader(const char* filepath); // Filepath of .obj file
 	~objLoader(); // Destructor
-	void drawObj(); // Drawing
+	void drawObj(int smooth = 0); // Drawing (flat or smooth normals)
+
+	// Send every triangle to OpenGL, without compiling display list
+	void drawTriangles(int smooth);
+
+	// Mesh of file shared by every caller, loaded on first request
+	static objLoader* load(const char* filepath);
+
+	// Packed mesh, each array a single allocation. One vertex for every
+	// distinct combination of position, texture coordinates and normal
+	// used by faces, with x, y, z, texture u, v (NULL if file has none) and
+	// unit normal x, y, z drawn when smooth (NULL if file has none,
+	// computed for vertices without one), and three vertex indices of every
+	// triangle
+	float *positions;
+	float *texCoords;
+	float *normals;
+	uint32_t *indices;
+
+	// Normals computed at load: unit normal of every triangle, and unit
+	// normal of every vertex from triangles around its position weighted by
+	// their area (shared across texture seams)
+	float *flatNormals;
+	float *smoothNormals;
+	int vertexCount;
+	int triangleCount;
 
 private:
-	char* filepath = NULL;
+	string filepath; // Copy of path given, for error messages
 
-	vector<vector<float>*> *vertices;
-	vector<vector<int>*> *faces;
+	// Display lists drawing mesh with flat and smooth normals, compiled on
+	// first draw of each (0 until then)
+	unsigned int displayLists[2];
 
-	// Split string given by a separator character
-	vector<string>* splitStr(string sentence, char separator);
-
-	// Converting string value to float
-	float convertStr(string sentence);
-
-	// Calculate normal
-	float* getNorm(float *coord1, float *coord2, float *coord3);
+	// Fill flat and smooth normals, given corner (file position, texture
+	// and normal index) of every vertex
+	void computeNormals(const int *corners, int positionCount);
 };
 
 #endif
@@ -17,10 +17,10 @@
 #include "object.h"
 #include "objLoader.h"
 
-// Loading object files
-objLoader *rock = new objLoader((char*)"Objects/rock.obj");
-objLoader *bomb = new objLoader((char*)"Objects/bomb.obj");
-objLoader *coin = new objLoader((char*)"Objects/coin.obj");
+// Loading object files, meshes shared by every object of a type
+objLoader *rock = objLoader::load("Objects/rock.obj");
+objLoader *bomb = objLoader::load("Objects/bomb.obj");
+objLoader *coin = objLoader::load("Objects/coin.obj");
 
 // Generic object constructor (set coordinates)
 Object::Object(float x, float y, float z)